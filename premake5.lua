@@ -62,7 +62,33 @@ project "game-of-life"
     language "C++"
     cppdialect "C++17"
     location "src/%{prj.name}"
-    files { "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp" }
+    includedirs { "src/raycasting" }
+    files {
+        "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp",
+        "src/raycasting/thread_pool.hpp", "src/raycasting/thread_pool.cpp",
+    }
+
+project "game-of-life-bench"
+    language "C++"
+    cppdialect "C++17"
+    location "src/%{prj.name}"
+    includedirs { "src/game-of-life", "src/raycasting" }
+    files {
+        "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp",
+        "src/game-of-life/**.h", "src/game-of-life/**.hpp", "src/game-of-life/**.cpp",
+        "src/raycasting/thread_pool.hpp", "src/raycasting/thread_pool.cpp",
+    }
+    removefiles { "src/game-of-life/main.cpp" }
+
+project "game-of-life-test"
+    language "C++"
+    cppdialect "C++17"
+    location "src/%{prj.name}"
+    includedirs { "src/game-of-life" }
+    files {
+        "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp",
+        "src/game-of-life/pattern.hpp", "src/game-of-life/pattern.cpp",
+    }
 
 project "times-table"
     language "C++"
@@ -88,8 +114,23 @@ project "raycasting"
     location "src/%{prj.name}"
     files { "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp" }
 
+project "raycasting-bench"
+    language "C++"
+    cppdialect "C++17"
+    location "src/%{prj.name}"
+    includedirs { "src/raycasting" }
+    files {
+        "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp",
+        "src/raycasting/**.h", "src/raycasting/**.hpp", "src/raycasting/**.cpp",
+    }
+    removefiles { "src/raycasting/main.cpp" }
+
 project "raycasting-mapeditor"
     language "C++"
     cppdialect "C++17"
     location "src/%{prj.name}"
-    files { "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp" }
\ No newline at end of file
+    includedirs { "src/raycasting" }
+    files {
+        "src/%{prj.name}/**.h", "src/%{prj.name}/**.hpp", "src/%{prj.name}/**.cpp",
+        "src/raycasting/map_format.hpp", "src/raycasting/map_format.cpp",
+    }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "life.hpp"
+#include "pattern.hpp"
+
+// Built-in seed patterns, all long-lived or growing under B3/S23
+struct seed_t {
+    const char *name;
+    const char *rle;
+};
+
+const seed_t SEEDS[] = {
+    { "r-pentomino", "b2o$2o$bo!" },
+    { "acorn", "bo$3bo$2o2b3o!" },
+    { "diehard", "6bo$2o$bo3b3o!" },
+    { "gosper-glider-gun",
+      "24bo$22bobo$12b2o6b2o12b2o$11bo3bo4b2o12b2o$2o8bo5bo3b2o$"
+      "2o8bo3bob2o4bobo$10bo5bo7bo$11bo3bo$12b2o!" },
+};
+
+struct options_t {
+    engine_t engine;
+    topology_t topology;
+    int threads;
+    int generations;
+    int width, height;
+    int soups;
+    int soup_size;
+    float density;
+    unsigned seed;
+    bool hashes;
+    // Empty runs every pattern under its own rule, B3/S23 if it has none
+    std::string rule;
+    std::vector<std::string> patterns;
+};
+
+void usage(const char *name)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] [pattern files...]\n"
+        "  --engine naive|tiled   update engine (default tiled)\n"
+        "  --topology dead|torus|klein  board edges (default dead)\n"
+        "  --threads N            worker threads (default 1)\n"
+        "  --generations N        generations per run (default 1000)\n"
+        "  --size WxH             board size (default 512x512)\n"
+        "  --soups N              random soups to run (default 4)\n"
+        "  --soup-size N          side of a random soup (default 64)\n"
+        "  --density D            soup density (default 0.5)\n"
+        "  --seed N               soup random seed (default 1)\n"
+        "  --rule RULE            rule for every run, over a pattern file's own\n"
+        "                         (default the file's, else B3/S23)\n"
+        "  --no-seeds             skip the built-in seed patterns\n"
+        "  --no-hashes            omit the per-generation hashes\n",
+        name);
+}
+
+pattern_t random_soup(std::mt19937 &random, int size, float density)
+{
+    pattern_t soup = { size, size, "", {} };
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            if (random() < density * float(random.max()))
+                soup.cells.push_back(pattern_cell_t { x, y, 1 });
+    return soup;
+}
+
+// Text as a quoted JSON string
+std::string json_string(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Cells of the tiles computed by the last step, edge tiles clipped to the
+// board. The naive engine computes them all.
+long long computed_cells(const life_t &life)
+{
+    long long cells = 0;
+    for (int tile : life.work) {
+        int x0 = tile % life.tiles_w * TILE_SIZE;
+        int y0 = tile / life.tiles_w * TILE_SIZE;
+        cells += (long long)std::min(TILE_SIZE, life.width - x0) *
+                 std::min(TILE_SIZE, life.height - y0);
+    }
+    return cells;
+}
+
+// Runs one pattern and prints its JSON object
+void run(const options_t &options, const std::string &name,
+         const pattern_t &pattern, bool first)
+{
+    life_t life(options.width, options.height);
+    life.engine = options.engine;
+    life.threads = options.threads;
+    life.set_topology(options.topology);
+    // An explicit --rule wins over the pattern's own
+    pattern_t loaded = pattern;
+    if (!options.rule.empty())
+        loaded.rule = options.rule;
+    life.load(loaded);
+
+    std::vector<uint64_t> hashes;
+    long long tiles = 0;
+    long long cells = 0;
+    double seconds = 0;
+    for (int i = 0; i < options.generations; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        life.step();
+        seconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        tiles += life.active_tiles;
+        cells += computed_cells(life);
+        if (options.hashes)
+            hashes.push_back(life.hash());
+    }
+
+    std::printf("%s    {\n", first ? "" : ",\n");
+    std::printf("      \"name\": %s,\n", json_string(name).c_str());
+    std::printf("      \"rule\": %s,\n", json_string(life.rule.name).c_str());
+    std::printf("      \"population\": %d,\n", life.population());
+    std::printf("      \"hash\": \"%016llx\",\n", (unsigned long long)life.hash());
+    std::printf("      \"seconds\": %.6f,\n", seconds);
+    std::printf("      \"generations_per_second\": %.1f,\n",
+                options.generations / seconds);
+    std::printf("      \"cell_updates_per_second\": %.1f,\n",
+                double(cells) / seconds);
+    std::printf("      \"active_tiles_per_generation\": %.1f,\n",
+                double(tiles) / options.generations);
+    std::printf("      \"period\": %d,\n", life.period);
+    std::printf("      \"stable_generation\": %lld", life.stable_generation);
+    if (options.hashes) {
+        std::printf(",\n      \"hashes\": [");
+        for (size_t i = 0; i < hashes.size(); ++i)
+            std::printf("%s\"%016llx\"", i ? ", " : "",
+                        (unsigned long long)hashes[i]);
+        std::printf("]");
+    }
+    std::printf("\n    }");
+}
+
+int main(int argc, char **argv)
+{
+    options_t options = {
+        ENGINE_TILED, TOPOLOGY_DEAD, 1, 1000, 512, 512, 4, 64, 0.5, 1, true, "", {}
+    };
+    bool seeds = true;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "--engine") && has_value) {
+            const char *engine = argv[++i];
+            if (!strcmp(engine, "naive"))
+                options.engine = ENGINE_NAIVE;
+            else if (!strcmp(engine, "tiled"))
+                options.engine = ENGINE_TILED;
+            else
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--topology") && has_value) {
+            const char *topology = argv[++i];
+            if (!strcmp(topology, "dead"))
+                options.topology = TOPOLOGY_DEAD;
+            else if (!strcmp(topology, "torus"))
+                options.topology = TOPOLOGY_TORUS;
+            else if (!strcmp(topology, "klein"))
+                options.topology = TOPOLOGY_KLEIN;
+            else
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--threads") && has_value) {
+            options.threads = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(arg, "--generations") && has_value) {
+            options.generations = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(arg, "--size") && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width,
+                            &options.height) != 2 ||
+                options.width <= 0 || options.height <= 0)
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--soups") && has_value) {
+            options.soups = std::max(std::atoi(argv[++i]), 0);
+        } else if (!strcmp(arg, "--soup-size") && has_value) {
+            options.soup_size = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(arg, "--density") && has_value) {
+            options.density = std::atof(argv[++i]);
+        } else if (!strcmp(arg, "--seed") && has_value) {
+            options.seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--rule") && has_value) {
+            options.rule = argv[++i];
+            rule_t rule;
+            if (!parse_rule(options.rule, &rule)) {
+                std::fprintf(stderr, "invalid rule: %s\n", options.rule.c_str());
+                return 1;
+            }
+        } else if (!strcmp(arg, "--no-seeds")) {
+            seeds = false;
+        } else if (!strcmp(arg, "--no-hashes")) {
+            options.hashes = false;
+        } else if (arg[0] == '-') {
+            return usage(argv[0]), 1;
+        } else {
+            options.patterns.push_back(arg);
+        }
+    }
+
+    std::printf("{\n");
+    std::printf("  \"engine\": \"%s\",\n",
+                options.engine == ENGINE_NAIVE ? "naive" : "tiled");
+    std::printf("  \"topology\": \"%s\",\n", topology_name(options.topology));
+    std::printf("  \"threads\": %d,\n", options.threads);
+    std::printf("  \"generations\": %d,\n", options.generations);
+    std::printf("  \"width\": %d,\n", options.width);
+    std::printf("  \"height\": %d,\n", options.height);
+    std::printf("  \"runs\": [\n");
+
+    bool first = true;
+    if (seeds) {
+        for (const seed_t &seed : SEEDS) {
+            pattern_t pattern;
+            read_pattern(seed.rle, FORMAT_RLE, &pattern);
+            run(options, seed.name, pattern, first);
+            first = false;
+        }
+    }
+    std::mt19937 random(options.seed);
+    for (int i = 0; i < options.soups; ++i) {
+        pattern_t soup = random_soup(random, options.soup_size, options.density);
+        run(options, "soup-" + std::to_string(i), soup, first);
+        first = false;
+    }
+    for (const std::string &filename : options.patterns) {
+        pattern_t pattern;
+        auto start = std::chrono::steady_clock::now();
+        if (!load_pattern(filename, &pattern)) {
+            std::fprintf(stderr, "failed to load %s\n", filename.c_str());
+            continue;
+        }
+        std::fprintf(stderr, "loaded %s in %.1f ms\n", filename.c_str(),
+                     std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start).count());
+        run(options, filename, pattern, first);
+        first = false;
+    }
+
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <string>
+#include "pattern.hpp"
+
+// Checks that the pattern parsers load ordinary files and reject ones that
+// would expand past MAX_PATTERN_SIZE or MAX_PATTERN_CELLS. Exits non-zero
+// on any failure.
+
+int failures = 0;
+
+void check(bool ok, const char *what)
+{
+    std::printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok)
+        failures++;
+}
+
+bool loads(const std::string &text, pattern_format_t format, size_t cells)
+{
+    pattern_t pattern;
+    return read_pattern(text, format, &pattern) && pattern.cells.size() == cells;
+}
+
+bool rejected(const std::string &text, pattern_format_t format)
+{
+    pattern_t pattern;
+    return !read_pattern(text, format, &pattern);
+}
+
+// A full 8x8 leaf, then nodes up to a level whose four children are all
+// the node before, a few hundred bytes that expand to 4^level cells
+std::string macrocell_bomb(int level)
+{
+    std::string text = "[M2] (golly 4.0)\n";
+    for (int y = 0; y < 8; ++y)
+        text += "********$";
+    text += "\n";
+    for (int l = 4; l <= level; ++l) {
+        int child = l - 3;
+        text += std::to_string(l);
+        for (int i = 0; i < 4; ++i)
+            text += " " + std::to_string(child);
+        text += "\n";
+    }
+    return text;
+}
+
+int main()
+{
+    check(loads("x = 3, y = 3\nbo$2bo$3o!", FORMAT_RLE, 5), "RLE glider");
+    check(loads(macrocell_bomb(5), FORMAT_MACROCELL, 32 * 32),
+          "small Macrocell square");
+    check(loads(".O\n..O\nOOO\n", FORMAT_PLAINTEXT, 5), "plaintext glider");
+
+    check(rejected("9999999999o!", FORMAT_RLE), "RLE run past the size limit");
+    check(rejected("65536$o!", FORMAT_RLE), "RLE row past the size limit");
+    std::string rows;
+    for (int y = 0; y < 65; ++y)
+        rows += "65536o$";
+    check(rejected(rows + "!", FORMAT_RLE), "RLE past the cell limit");
+
+    check(rejected(macrocell_bomb(14), FORMAT_MACROCELL),
+          "Macrocell bomb past the cell limit");
+    check(rejected(macrocell_bomb(17), FORMAT_MACROCELL),
+          "Macrocell root past the size limit");
+    check(rejected("[M2]\n********$\n5 1 1 1 1\n", FORMAT_MACROCELL),
+          "Macrocell child of the wrong level");
+
+    return failures ? 1 : 0;
+}
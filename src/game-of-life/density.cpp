@@ -0,0 +1,58 @@
+#include "density.hpp"
+#include <algorithm>
+
+density_t::density_t(int width, int height) : width(width), height(height)
+{
+    // Halve the board until a single block covers it
+    levels.resize(1);
+    for (int level = 1; level_width(level - 1) > 1 || level_height(level - 1) > 1;
+         ++level)
+        levels.emplace_back(level_width(level) * level_height(level), 0);
+}
+
+int density_t::level_count() const
+{
+    return int(levels.size());
+}
+
+int density_t::level_width(int level) const
+{
+    return level_size(width, level);
+}
+
+int density_t::level_height(int level) const
+{
+    return level_size(height, level);
+}
+
+void density_t::update(life_t &life)
+{
+    for (int tile = 0; tile < life.tiles_w * life.tiles_h; ++tile) {
+        if (!(life.dirty[tile] & DIRTY_DENSITY))
+            continue;
+        life.dirty[tile] &= ~DIRTY_DENSITY;
+        // Cells covered by the tile, then the blocks covering those on
+        // every level. A block shared with a tile updated later is simply
+        // counted again, by then with all of its children up to date.
+        int x0 = tile % life.tiles_w * TILE_SIZE;
+        int y0 = tile / life.tiles_w * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, width) - 1;
+        int y1 = std::min(y0 + TILE_SIZE, height) - 1;
+        for (int level = 1; level < level_count(); ++level) {
+            int w = level_width(level);
+            int below_w = level_width(level - 1);
+            int below_h = level_height(level - 1);
+            const std::vector<uint32_t> &below = levels[level - 1];
+            for (int by = y0 >> level; by <= y1 >> level; ++by) {
+                for (int bx = x0 >> level; bx <= x1 >> level; ++bx) {
+                    uint32_t count = 0;
+                    for (int y = 2 * by; y < std::min(2 * by + 2, below_h); ++y)
+                        for (int x = 2 * bx; x < std::min(2 * bx + 2, below_w); ++x)
+                            count += (level == 1) ? (life.get(x, y) == 1)
+                                                  : below[y * below_w + x];
+                    levels[level][by * w + bx] = count;
+                }
+            }
+        }
+    }
+}
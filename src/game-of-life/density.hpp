@@ -0,0 +1,31 @@
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+#include <cstdint>
+#include <vector>
+#include "life.hpp"
+
+// Blocks needed to cover a side of the board at a level
+inline int level_size(int size, int level)
+{
+    return (size + (1 << level) - 1) >> level;
+}
+
+// Population counts of the board at every power of two scale, used to draw
+// the board zoomed out: block (x, y) of level L counts the alive cells in
+// the 2^L x 2^L square of cells starting at (x << L, y << L). Level 0 is
+// the board itself and is not stored.
+struct density_t {
+    int width, height;
+    std::vector<std::vector<uint32_t>> levels;
+
+    density_t(int width, int height);
+
+    int level_count() const;
+    int level_width(int level) const;
+    int level_height(int level) const;
+    // Recount the blocks over the tiles changed since the last update
+    void update(life_t &life);
+};
+
+#endif // DENSITY_HPP
@@ -0,0 +1,411 @@
+#include "life.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+
+// Below this many active tiles per thread, waking the workers costs more
+// than it saves and step() stays on the calling thread
+const int MIN_TILES_PER_THREAD = 16;
+
+const char *topology_name(topology_t topology)
+{
+    switch (topology) {
+    case TOPOLOGY_DEAD:
+        return "dead";
+    case TOPOLOGY_TORUS:
+        return "torus";
+    case TOPOLOGY_KLEIN:
+        return "klein";
+    }
+    return "";
+}
+
+void period_detector_t::reset()
+{
+    count = 0;
+    candidate = 0;
+    streak = 0;
+}
+
+int period_detector_t::push(uint64_t hash)
+{
+    int found = 0;
+    for (int p = 1; p <= MAX_PERIOD && p <= count; ++p) {
+        if (hashes[(count - p) % MAX_PERIOD] == hash) {
+            found = p;
+            break;
+        }
+    }
+    hashes[count % MAX_PERIOD] = hash;
+    count++;
+
+    if (found && found == candidate) {
+        streak++;
+    } else {
+        candidate = found;
+        streak = found ? 1 : 0;
+    }
+    return (candidate && streak >= candidate) ? candidate : 0;
+}
+
+life_t::life_t(int width, int height)
+    : width(width), height(height),
+      tiles_w((width + TILE_SIZE - 1) / TILE_SIZE),
+      tiles_h((height + TILE_SIZE - 1) / TILE_SIZE),
+      generation(0), active_tiles(0), rule(conway_rule()),
+      engine(ENGINE_TILED), topology(TOPOLOGY_DEAD), threads(1),
+      pad(0), stride(width),
+      active(tiles_w * tiles_h, 0), next_active(tiles_w * tiles_h, 0),
+      dirty(tiles_w * tiles_h, DIRTY_ALL), board_hash(0)
+{
+    resize_halo();
+    reset_history();
+}
+
+life_t::~life_t() = default;
+
+void life_t::reset_history()
+{
+    period = 0;
+    stable_generation = 0;
+    history.reset();
+}
+
+bool life_t::is_valid(int x, int y) const
+{
+    return ((x >= 0 && x < width) && (y >= 0 && y < height));
+}
+
+uint8_t life_t::get(int x, int y) const
+{
+    return cells[index(x, y)];
+}
+
+void life_t::set(int x, int y, uint8_t state)
+{
+    // Write both buffers so that a tile which ends up unchanged after the
+    // edit does not leave a stale copy behind in the back buffer
+    if (state >= rule.states)
+        state = 1;
+    int i = y * width + x;
+    board_hash ^= cell_key(i, cells[index(x, y)]) ^ cell_key(i, state);
+    reset_history();
+    cells[index(x, y)] = state;
+    buf[index(x, y)] = state;
+    int tx = x / TILE_SIZE, ty = y / TILE_SIZE;
+    dirty[ty * tiles_w + tx] = DIRTY_ALL;
+    wake_tile(active, tx, ty);
+    if (topology != TOPOLOGY_DEAD && is_border_tile(tx, ty))
+        wake_border(active);
+}
+
+void life_t::set_rule(const rule_t &rule)
+{
+    this->rule = rule;
+    for (uint8_t &cell : cells)
+        if (cell >= rule.states)
+            cell = 0;
+    resize_halo();
+    rehash();
+    reset_history();
+    std::fill(active.begin(), active.end(), 1);
+    std::fill(dirty.begin(), dirty.end(), DIRTY_ALL);
+    sat.clear();
+}
+
+void life_t::set_topology(topology_t topology)
+{
+    this->topology = topology;
+    reset_history();
+    std::fill(active.begin(), active.end(), 1);
+}
+
+void life_t::resize_halo()
+{
+    int new_pad = rule.radius;
+    int new_stride = width + 2 * new_pad;
+    std::vector<uint8_t> resized(new_stride * (height + 2 * new_pad), 0);
+    if (!cells.empty())
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                resized[(y + new_pad) * new_stride + x + new_pad] =
+                    cells[index(x, y)];
+    pad = new_pad;
+    stride = new_stride;
+    cells = resized;
+    buf = resized;
+}
+
+void life_t::fill_halo()
+{
+    for (int py = 0; py < height + 2 * pad; ++py) {
+        int y = py - pad;
+        bool inside_y = (y >= 0 && y < height);
+        int wy = ((y % height) + height) % height;
+        // Crossing the top or bottom edge of a Klein bottle an odd number
+        // of times mirrors the row
+        bool flip = topology == TOPOLOGY_KLEIN && ((y - wy) / height) % 2;
+        for (int px = 0; px < stride; ++px) {
+            // Rows inside the board only need their left and right halo
+            if (inside_y && px == pad)
+                px += width;
+            if (px >= stride)
+                break;
+            int x = px - pad;
+            int wx = ((x % width) + width) % width;
+            if (flip)
+                wx = width - 1 - wx;
+            cells[py * stride + px] =
+                topology == TOPOLOGY_DEAD ? 0 : cells[index(wx, wy)];
+        }
+    }
+}
+
+void life_t::clear()
+{
+    std::fill(cells.begin(), cells.end(), 0);
+    std::fill(buf.begin(), buf.end(), 0);
+    std::fill(active.begin(), active.end(), 0);
+    std::fill(dirty.begin(), dirty.end(), DIRTY_ALL);
+    generation = 0;
+    active_tiles = 0;
+    board_hash = 0;
+    reset_history();
+}
+
+void life_t::load(const pattern_t &pattern)
+{
+    clear();
+    rule_t rule;
+    if (!pattern.rule.empty() && parse_rule(pattern.rule, &rule))
+        set_rule(rule);
+    int ox = (width - pattern.width) / 2;
+    int oy = (height - pattern.height) / 2;
+    for (const pattern_cell_t &cell : pattern.cells)
+        if (is_valid(ox + cell.x, oy + cell.y))
+            set(ox + cell.x, oy + cell.y, cell.state);
+}
+
+void life_t::restore(const std::vector<uint8_t> &cells, long long generation)
+{
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t state = cells[y * width + x];
+            if (state >= rule.states)
+                state = 1;
+            this->cells[index(x, y)] = state;
+            buf[index(x, y)] = state;
+        }
+    }
+    this->generation = generation;
+    rehash();
+    reset_history();
+    std::fill(active.begin(), active.end(), 1);
+    std::fill(dirty.begin(), dirty.end(), DIRTY_ALL);
+}
+
+int life_t::population() const
+{
+    int count = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            count += (cells[index(x, y)] == 1);
+    return count;
+}
+
+uint64_t life_t::hash() const
+{
+    return board_hash;
+}
+
+void life_t::rehash()
+{
+    board_hash = 0;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            board_hash ^= cell_key(y * width + x, cells[index(x, y)]);
+}
+
+void life_t::copy_cells(std::vector<uint8_t> *out) const
+{
+    out->resize(width * height);
+    for (int y = 0; y < height; ++y)
+        std::copy_n(&cells[index(0, y)], width, &(*out)[y * width]);
+}
+
+void life_t::wake_tile(std::vector<uint8_t> &tiles, int tx, int ty)
+{
+    // Cells up to the rule's radius away are affected by a change
+    int reach = (rule.radius + TILE_SIZE - 1) / TILE_SIZE;
+    int x0 = std::max(tx - reach, 0), x1 = std::min(tx + reach, tiles_w - 1);
+    int y0 = std::max(ty - reach, 0), y1 = std::min(ty + reach, tiles_h - 1);
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            tiles[y * tiles_w + x] = 1;
+}
+
+bool life_t::is_border_tile(int tx, int ty) const
+{
+    // Tiles this close to an edge see cells from another edge through the
+    // halo. One extra tile covers a partial tile at the far edges.
+    int reach = (rule.radius + TILE_SIZE - 1) / TILE_SIZE + 1;
+    return tx < reach || ty < reach ||
+           tx >= tiles_w - reach || ty >= tiles_h - reach;
+}
+
+void life_t::wake_border(std::vector<uint8_t> &tiles)
+{
+    int reach = (rule.radius + TILE_SIZE - 1) / TILE_SIZE + 1;
+    for (int ty = 0; ty < tiles_h; ++ty) {
+        bool border_row = (ty < reach || ty >= tiles_h - reach);
+        for (int tx = 0; tx < tiles_w; ++tx) {
+            if (!border_row && tx == reach)
+                tx = std::max(tx, tiles_w - reach);
+            tiles[ty * tiles_w + tx] = 1;
+        }
+    }
+}
+
+void life_t::build_sat()
+{
+    // sat[(y + 1) * (stride + 1) + x + 1] is the number of live cells in
+    // the rectangle from (0, 0) to (x, y) inclusive, halo included
+    int sat_stride = stride + 1;
+    int rows = height + 2 * pad;
+    sat.assign(sat_stride * (rows + 1), 0);
+    for (int y = 0; y < rows; ++y) {
+        int row = 0;
+        for (int x = 0; x < stride; ++x) {
+            row += (cells[y * stride + x] == 1);
+            sat[(y + 1) * sat_stride + x + 1] =
+                sat[y * sat_stride + x + 1] + row;
+        }
+    }
+}
+
+int life_t::count_moore(int sx, int sy) const
+{
+    // Count alive cells around, the halo makes every neighbour addressable
+    const uint8_t *cell = &cells[index(sx, sy)];
+    const uint8_t *up = cell - stride;
+    const uint8_t *down = cell + stride;
+    return (up[-1] == 1) + (up[0] == 1) + (up[1] == 1) +
+           (cell[-1] == 1) + (cell[1] == 1) +
+           (down[-1] == 1) + (down[0] == 1) + (down[1] == 1);
+}
+
+int life_t::count_sat(int sx, int sy) const
+{
+    // The halo is as wide as the radius, so the box is never clipped
+    int sat_stride = stride + 1;
+    int x0 = sx + pad - rule.radius, x1 = sx + pad + rule.radius + 1;
+    int y0 = sy + pad - rule.radius, y1 = sy + pad + rule.radius + 1;
+    int alive = sat[y1 * sat_stride + x1] - sat[y0 * sat_stride + x1] -
+                sat[y1 * sat_stride + x0] + sat[y0 * sat_stride + x0];
+    if (!rule.middle)
+        alive -= (cells[index(sx, sy)] == 1);
+    return alive;
+}
+
+bool life_t::update_tile(int tx, int ty, uint64_t *delta)
+{
+    bool changed = false;
+    *delta = 0;
+    int x0 = tx * TILE_SIZE, x1 = std::min(x0 + TILE_SIZE, width);
+    int y0 = ty * TILE_SIZE, y1 = std::min(y0 + TILE_SIZE, height);
+    for (int sy = y0; sy < y1; ++sy) {
+        for (int sx = x0; sx < x1; ++sx) {
+            int alive = rule.radius == 1 ? count_moore(sx, sy)
+                                         : count_sat(sx, sy);
+            // Update current cell based on its neighbors
+            uint8_t cell = cells[index(sx, sy)];
+            uint8_t next = rule.next(cell, alive);
+            buf[index(sx, sy)] = next;
+            if (next != cell) {
+                int i = sy * width + sx;
+                *delta ^= cell_key(i, cell) ^ cell_key(i, next);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+void life_t::update_tiles(int begin, int end)
+{
+    for (int i = begin; i < end; ++i)
+        changed[i] = update_tile(work[i] % tiles_w, work[i] / tiles_w,
+                                 &deltas[i]);
+}
+
+void life_t::step()
+{
+    // Tiles skipped here hold the same cells in both buffers: they were
+    // either unchanged by the last generation or skipped themselves
+    std::fill(next_active.begin(), next_active.end(), 0);
+    if (engine == ENGINE_NAIVE || rule.births_on_zero())
+        std::fill(active.begin(), active.end(), 1);
+    fill_halo();
+    if (rule.radius > 1)
+        build_sat();
+
+    work.clear();
+    for (int i = 0; i < tiles_w * tiles_h; ++i)
+        if (active[i])
+            work.push_back(i);
+    active_tiles = work.size();
+    changed.resize(work.size());
+    deltas.resize(work.size());
+
+    // Tiles only write their own cells, so they can be updated in parallel
+    int count = work.size();
+    if (threads <= 1 || count < threads * MIN_TILES_PER_THREAD) {
+        update_tiles(0, count);
+    } else {
+        if (!pool || pool->size() != threads)
+            pool = std::make_unique<thread_pool_t>(threads);
+        // More chunks than threads, so that a thread stuck with busy tiles
+        // doesn't hold up the others
+        int chunks = threads * 4;
+        pool->run(chunks, [&](int i) {
+            update_tiles(count * i / chunks, count * (i + 1) / chunks);
+        });
+    }
+
+    bool border_changed = false;
+    for (int i = 0; i < count; ++i) {
+        if (!changed[i])
+            continue;
+        int tx = work[i] % tiles_w, ty = work[i] / tiles_w;
+        board_hash ^= deltas[i];
+        dirty[work[i]] = DIRTY_ALL;
+        wake_tile(next_active, tx, ty);
+        border_changed |= is_border_tile(tx, ty);
+    }
+    if (topology != TOPOLOGY_DEAD && border_changed)
+        wake_border(next_active);
+    // Save new generation to the board
+    cells.swap(buf);
+    active.swap(next_active);
+    generation++;
+
+    if (!period) {
+        period = history.push(board_hash);
+        if (period)
+            stable_generation = generation;
+    }
+}
+
+void life_t::fast_forward(long long generations)
+{
+    while (generations > 0) {
+        if (period) {
+            long long skipped = generations - generations % period;
+            generation += skipped;
+            generations -= skipped;
+            if (!generations)
+                break;
+        }
+        step();
+        generations--;
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef LIFE_HPP
+#define LIFE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "pattern.hpp"
+#include "rule.hpp"
+
+struct thread_pool_t;
+
+// Side of a square tile in cells. Tiles are the unit of active-region
+// tracking: a tile is recomputed only if it or a neighbouring tile within
+// the rule's radius changed during the previous generation.
+const int TILE_SIZE = 8;
+
+enum engine_t {
+    // Recompute every tile each generation
+    ENGINE_NAIVE,
+    // Recompute only the active tiles
+    ENGINE_TILED,
+};
+
+// What lies beyond the edges of the board
+enum topology_t {
+    // Dead cells
+    TOPOLOGY_DEAD,
+    // Opposite edges are joined
+    TOPOLOGY_TORUS,
+    // Left and right edges are joined, top and bottom are joined with the
+    // x axis flipped
+    TOPOLOGY_KLEIN,
+};
+
+const char *topology_name(topology_t topology);
+
+// Bits of life_t::dirty, one per reader of the changed tiles. A change sets
+// all of them and each reader clears its own.
+const uint8_t DIRTY_DENSITY = 1 << 0;
+const uint8_t DIRTY_TIMELINE = 1 << 1;
+// One bit per frame of the simulation's triple buffer, from this one up
+const uint8_t DIRTY_FRAME = 1 << 2;
+const uint8_t DIRTY_ALL = 0xff;
+
+// Key of a cell in the board hash. The hash is the XOR of the keys of all
+// non-dead cells, so it does not depend on the order cells are visited in.
+inline uint64_t cell_key(int index, uint8_t state)
+{
+    if (!state)
+        return 0;
+    // splitmix64 finalizer
+    uint64_t z = (uint64_t(index) << 8 | state) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Longest oscillator period detected
+const int MAX_PERIOD = 64;
+
+// Ring of the last MAX_PERIOD board hashes. A board is reported periodic
+// once its hash has repeated with the same period for a whole period.
+struct period_detector_t {
+    uint64_t hashes[MAX_PERIOD];
+    long long count;
+    int candidate;
+    int streak;
+
+    void reset();
+    // Returns the period of the board (1 for a still life) or 0
+    int push(uint64_t hash);
+};
+
+struct life_t {
+    int width, height;
+    int tiles_w, tiles_h;
+    long long generation;
+    // Number of tiles computed by the last call to step()
+    int active_tiles;
+    rule_t rule;
+    engine_t engine;
+    topology_t topology;
+    // Threads used by step(), tiles are handed out to them in chunks
+    int threads;
+    // Period of the board once it has become periodic, 0 before that, and
+    // the generation where this was detected
+    int period;
+    long long stable_generation;
+    period_detector_t history;
+
+    // Cell states: 0 is dead, 1 is alive and anything above is a dying cell
+    // of a Generations rule. The board is surrounded by a halo as wide as
+    // the rule's radius, filled from the topology before every generation,
+    // so counting neighbours never needs a bounds check.
+    int pad, stride;
+    std::vector<uint8_t> cells;
+    std::vector<uint8_t> buf;
+    std::vector<uint8_t> active;
+    std::vector<uint8_t> next_active;
+    // Tiles changed since each reader, such as density_t, last cleared its
+    // DIRTY_* bit, so that it only has to look at those
+    std::vector<uint8_t> dirty;
+    // Indices of the tiles computed this generation, whether they changed
+    // and how they changed the board hash
+    std::vector<int> work;
+    std::vector<uint8_t> changed;
+    std::vector<uint64_t> deltas;
+    uint64_t board_hash;
+    // Summed-area table of live cells over the board and its halo, only
+    // used by Larger than Life rules
+    std::vector<int> sat;
+
+    life_t(int width, int height);
+    ~life_t();
+
+    bool is_valid(int x, int y) const;
+    uint8_t get(int x, int y) const;
+    void set(int x, int y, uint8_t state);
+    void set_rule(const rule_t &rule);
+    void set_topology(topology_t topology);
+    void clear();
+    // Replace the board with a pattern centered on it, clipping what
+    // doesn't fit, and switch to the pattern's rule if it has one
+    void load(const pattern_t &pattern);
+    // Replace the board with cells laid out as by copy_cells()
+    void restore(const std::vector<uint8_t> &cells, long long generation);
+    void step();
+    // Advance a number of generations. Once the board is periodic only the
+    // remainder modulo the period is actually computed.
+    void fast_forward(long long generations);
+    int population() const;
+    // Maintained incrementally by set() and step()
+    uint64_t hash() const;
+    // Copy the board without its halo, row by row
+    void copy_cells(std::vector<uint8_t> *out) const;
+
+private:
+    // Started by the first step() on more than one thread and kept for the
+    // next ones
+    std::unique_ptr<thread_pool_t> pool;
+
+    int index(int x, int y) const
+    {
+        return (y + pad) * stride + x + pad;
+    }
+
+    void resize_halo();
+    void fill_halo();
+    void build_sat();
+    int count_moore(int sx, int sy) const;
+    int count_sat(int sx, int sy) const;
+    void reset_history();
+    void rehash();
+    bool update_tile(int tx, int ty, uint64_t *delta);
+    void update_tiles(int begin, int end);
+    void wake_tile(std::vector<uint8_t> &tiles, int tx, int ty);
+    bool is_border_tile(int tx, int ty) const;
+    void wake_border(std::vector<uint8_t> &tiles);
+};
+
+#endif // LIFE_HPP
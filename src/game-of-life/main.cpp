@@ -1,100 +1,400 @@
 #define RAYEXT_IMPLEMENTATION
 #include <raylib-ext.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "simulation.hpp"
 
 const Color BG_COLOR = BLACK;
 const Color ACTIVE_COLOR = GREEN;
 const Color BORDER_COLOR = DARKGRAY;
+const Color TEXT_COLOR = WHITE;
 
 const int WINDOW_W = 800;
 const int WINDOW_H = 800;
 
+// The window shows part of a larger board. The mouse wheel zooms by
+// powers of two around the cursor and the middle button pans.
 const int SQUARE_SIZE = 20;
-const int BOARD_W = WINDOW_W / SQUARE_SIZE;
-const int BOARD_H = WINDOW_H / SQUARE_SIZE;
-bool board[BOARD_H][BOARD_W] = {0};
+const int BOARD_W = 1024;
+const int BOARD_H = 1024;
+const float MIN_ZOOM = SQUARE_SIZE / 64.0f;
+const float MAX_ZOOM = SQUARE_SIZE * 4.0f;
+// Grid lines are only drawn when cells are at least this many pixels wide
+const float MIN_GRID_ZOOM = 8;
 
-bool is_valid(int x, int y)
+// Target generations per second is doubled/halved with the arrow keys,
+// going above the maximum switches to unlimited
+const float MIN_RATE = 1;
+const float MAX_RATE = 1024;
+
+// Rules cycled through with L
+const char *RULES[] = {
+    "B3/S23",                         // Life
+    "B36/S23",                        // HighLife
+    "B3678/S34678",                   // Day & Night
+    "B2/S/C3",                        // Brian's Brain
+    "B2/S345/C4",                     // Star Wars
+    "R5,C0,M1,S34..58,B34..45,NM",    // Bosco's Rule
+};
+const int RULES_COUNT = sizeof(RULES) / sizeof(RULES[0]);
+
+// Scrub bar over the bottom of the board, shown while paused
+const Rectangle TIMELINE_BOUNDS = { 90, WINDOW_H - 30, WINDOW_W - 180, 20 };
+
+// One grid cell with its top and left border, tiled over the whole board
+// so the grid is a single draw call
+Texture2D load_grid_texture(int size)
 {
-    return ((x >= 0 && x < BOARD_W) && (y >= 0 && y < BOARD_H));
+    Image image = GenImageColor(size, size, BLANK);
+    ImageDrawLine(&image, 0, 0, size, 0, BORDER_COLOR);
+    ImageDrawLine(&image, 0, 0, 0, size, BORDER_COLOR);
+    Texture2D texture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    SetTextureWrap(texture, TEXTURE_WRAP_REPEAT);
+    return texture;
 }
 
-void update_board()
+// Zoomed out, the board is drawn from the coarsest density level whose
+// blocks are still at least a pixel wide, so the work done per frame
+// depends on the size of the window rather than of the board
+int view_level(float zoom, int levels)
 {
-    bool buf[BOARD_H][BOARD_W] = {0};
-    for (int sy = 0; sy < BOARD_H; ++sy) {
-        for (int sx = 0; sx < BOARD_W; ++sx) {
-            // Count alive cells around
-            int alive = 0;
-            for (int i = 0; i < 9; ++i) {
-                int x = sx - 1 + i % 3;
-                int y = sy - 1 + i / 3;
-                if (is_valid(x, y) && (x != sx || y != sy))
-                    alive += board[y][x];
-            }
-            // Update current cell based on its neighbors
-            if (board[sy][sx])
-                buf[sy][sx] = (alive == 2 || alive == 3);
-            else
-                buf[sy][sx] = (alive == 3);
+    int level = 0;
+    while (level + 1 < levels && zoom * (1 << level) < 1)
+        level++;
+    return level;
+}
+
+// Bresenham's line between two cells, cells off the board are dropped
+// later by the simulation
+void paint_line(std::vector<edit_t> *batch, int x0, int y0, int x1, int y1,
+                bool alive)
+{
+    int dx = std::abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -std::abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    while (true) {
+        batch->push_back(edit_t { x0, y0, alive });
+        if (x0 == x1 && y0 == y1)
+            break;
+        int e2 = 2 * error;
+        if (e2 >= dy) {
+            error += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            error += dx;
+            y0 += sy;
         }
     }
-    // Save new generation to the board
-    memcpy(board, buf, sizeof(buf));
 }
 
-int main()
+// Loads a pattern file onto the board and describes the result
+std::string load_pattern_file(simulation_t &sim, const std::string &filename)
+{
+    pattern_t pattern;
+    double start = GetTime();
+    if (!load_pattern(filename, &pattern))
+        return "failed to load " + filename;
+    double elapsed = GetTime() - start;
+    std::string status = TextFormat("loaded %s: %d cells, %dx%d in %.1f ms",
+                                    GetFileName(filename.c_str()),
+                                    int(pattern.cells.size()), pattern.width,
+                                    pattern.height, elapsed * 1000);
+    sim.load(std::move(pattern));
+    return status;
+}
+
+std::string save_pattern_file(const frame_t &frame, const std::string &filename)
+{
+    pattern_t pattern = pattern_from_cells(frame.cells, BOARD_W, BOARD_H);
+    pattern.rule = frame.rule;
+    if (!save_pattern(filename, pattern))
+        return "failed to save " + filename;
+    return "saved " + filename;
+}
+
+int main(int argc, char **argv)
 {
     InitWindow(WINDOW_W, WINDOW_H, "Creative Coding: Game of Life");
     SetTargetFPS(60);
 
-    // Game state
-    bool is_running = false;
-    float timeout = 0;
+    simulation_t sim(BOARD_W, BOARD_H);
+    sim.start();
+
+    // Patterns are loaded from the command line or dropped on the window,
+    // and saved with R (.rle), M (.mc) or P (.cells)
+    std::string status = "";
+    if (argc > 1)
+        status = load_pattern_file(sim, argv[1]);
+
+    // Every level of the board is a texture with one pixel per cell or
+    // block, scaled up with nearest filtering. Only the part in view is
+    // uploaded.
+    int level_count = int(sim.acquire().density.size());
+    std::vector<Texture2D> level_textures;
+    for (int level = 0; level < level_count; ++level) {
+        Image image = GenImageColor(level_size(BOARD_W, level),
+                                    level_size(BOARD_H, level), BG_COLOR);
+        level_textures.push_back(LoadTextureFromImage(image));
+        UnloadImage(image);
+        SetTextureFilter(level_textures.back(), TEXTURE_FILTER_POINT);
+    }
+    std::vector<Color> pixels;
+    Rectangle uploaded_rect = { 0, 0, 0, 0 };
+    int uploaded_level = -1;
+    long long uploaded_sequence = -1;
+
+    // Camera: pixels per cell and the board position of the window's top
+    // left corner, in cells
+    float zoom = SQUARE_SIZE;
+    Vector2 view = { (BOARD_W - WINDOW_W / zoom) / 2,
+                     (BOARD_H - WINDOW_H / zoom) / 2 };
+    Texture2D grid_texture = load_grid_texture(int(zoom));
+    int rule_index = 0;
+    topology_t topology = TOPOLOGY_DEAD;
+    std::vector<edit_t> batch;
+    bool stroking = false;
+    int stroke_x = 0, stroke_y = 0;
+
+    // Measured simulation speed
+    float rate = 0;
+    double rate_time = GetTime();
+    long long rate_generation = 0;
 
     while (!WindowShouldClose()) {
-        // Draw on the board
-        if (!is_running) {
-            int sx = GetMouseX() / SQUARE_SIZE;
-            int sy = GetMouseY() / SQUARE_SIZE;
-            if (IsMouseButtonDown(MOUSE_BUTTON_LEFT))
-                board[sy][sx] = 1;
-            else if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT))
-                board[sy][sx] = 0;
+        // Move the camera
+        Vector2 mouse = GetMousePosition();
+        float wheel = GetMouseWheelMove();
+        if (wheel != 0) {
+            Vector2 cell = { view.x + mouse.x / zoom, view.y + mouse.y / zoom };
+            float zoomed = std::clamp(wheel > 0 ? zoom * 2 : zoom / 2,
+                                      MIN_ZOOM, MAX_ZOOM);
+            if (zoomed != zoom) {
+                zoom = zoomed;
+                view = { cell.x - mouse.x / zoom, cell.y - mouse.y / zoom };
+                if (zoom >= MIN_GRID_ZOOM) {
+                    UnloadTexture(grid_texture);
+                    grid_texture = load_grid_texture(int(zoom));
+                }
+            }
+        }
+        if (IsMouseButtonDown(MOUSE_BUTTON_MIDDLE)) {
+            Vector2 delta = GetMouseDelta();
+            view.x -= delta.x / zoom;
+            view.y -= delta.y / zoom;
+        }
+
+        // Draw on the board. Cells between the mouse positions of two
+        // frames are filled in too, and a stroke is undone as a whole.
+        bool on_timeline = !sim.running &&
+            CheckCollisionPointRec(mouse, TIMELINE_BOUNDS);
+        bool left = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
+        bool right = IsMouseButtonDown(MOUSE_BUTTON_RIGHT);
+        if ((left || right) && (stroking || !on_timeline)) {
+            int sx = int(std::floor(view.x + mouse.x / zoom));
+            int sy = int(std::floor(view.y + mouse.y / zoom));
+            if (!stroking || sx != stroke_x || sy != stroke_y) {
+                batch.clear();
+                paint_line(&batch, stroking ? stroke_x : sx,
+                           stroking ? stroke_y : sy, sx, sy, left);
+                sim.paint(batch);
+            }
+            stroking = true;
+            stroke_x = sx;
+            stroke_y = sy;
+        } else if (stroking) {
+            stroking = false;
+            sim.end_stroke();
         }
 
         // Change game state
         if (IsKeyPressed(KEY_SPACE))
-            is_running = !is_running;
+            sim.running = !sim.running;
+        if (IsKeyPressed(KEY_UP)) {
+            float target = sim.target_rate;
+            if (target > 0)
+                sim.target_rate = (target * 2 > MAX_RATE) ? 0 : target * 2;
+        } else if (IsKeyPressed(KEY_DOWN)) {
+            float target = sim.target_rate;
+            sim.target_rate = (target == 0) ? MAX_RATE
+                                            : std::max(target / 2, MIN_RATE);
+        }
+
+        // Z and Y undo and redo, left and right step through the history
+        if (IsKeyPressed(KEY_Z))
+            sim.undo();
+        else if (IsKeyPressed(KEY_Y))
+            sim.redo();
+
+        if (IsFileDropped()) {
+            int count;
+            char **files = GetDroppedFiles(&count);
+            if (count > 0)
+                status = load_pattern_file(sim, files[0]);
+            ClearDroppedFiles();
+        }
+
+        // F toggles between pausing and fast-forwarding periodic boards
+        if (IsKeyPressed(KEY_F))
+            sim.on_stable = (sim.on_stable == STABLE_PAUSE) ? STABLE_FAST_FORWARD
+                                                            : STABLE_PAUSE;
+        if (IsKeyPressed(KEY_T)) {
+            topology = topology_t((topology + 1) % 3);
+            sim.set_topology(topology);
+        }
+        if (IsKeyPressed(KEY_L)) {
+            rule_index = (rule_index + 1) % RULES_COUNT;
+            rule_t rule;
+            parse_rule(RULES[rule_index], &rule);
+            sim.set_rule(rule);
+        }
+
+        double now = GetTime();
+        if (now - rate_time >= 0.5) {
+            long long generation = sim.generation;
+            rate = (generation - rate_generation) / (now - rate_time);
+            rate_generation = generation;
+            rate_time = now;
+        }
+
+        const frame_t &frame = sim.acquire();
+
+        // Blocks of the chosen level in view, clipped to the board
+        int level = view_level(zoom, level_count);
+        float block = float(1 << level);
+        int lw = level_size(BOARD_W, level), lh = level_size(BOARD_H, level);
+        int bx0 = std::clamp(int(std::floor(view.x / block)), 0, lw);
+        int by0 = std::clamp(int(std::floor(view.y / block)), 0, lh);
+        int bx1 = std::clamp(int(std::ceil((view.x + WINDOW_W / zoom) / block)),
+                             bx0, lw);
+        int by1 = std::clamp(int(std::ceil((view.y + WINDOW_H / zoom) / block)),
+                             by0, lh);
+        Rectangle visible = { float(bx0), float(by0), float(bx1 - bx0),
+                              float(by1 - by0) };
+        bool moved = level != uploaded_level || visible.x != uploaded_rect.x ||
+                     visible.y != uploaded_rect.y ||
+                     visible.width != uploaded_rect.width ||
+                     visible.height != uploaded_rect.height;
+        if ((frame.sequence != uploaded_sequence || moved) &&
+            bx1 > bx0 && by1 > by0) {
+            // Dying states of Generations rules fade out towards the
+            // background, blocks are shaded by how many cells are alive
+            Color palette[256];
+            palette[0] = BG_COLOR;
+            palette[1] = ACTIVE_COLOR;
+            for (int s = 2; s < frame.states; ++s)
+                palette[s] = ColorAlpha(ACTIVE_COLOR,
+                                        1 - float(s - 1) / frame.states);
+            float area = block * block;
+            pixels.resize((bx1 - bx0) * (by1 - by0));
+            Color *pixel = pixels.data();
+            for (int by = by0; by < by1; ++by) {
+                for (int bx = bx0; bx < bx1; ++bx) {
+                    if (level == 0) {
+                        *pixel++ = palette[frame.cells[by * BOARD_W + bx]];
+                    } else {
+                        uint32_t count = frame.density[level][by * lw + bx];
+                        *pixel++ = count ? ColorAlpha(ACTIVE_COLOR,
+                                                      std::sqrt(count / area))
+                                         : BG_COLOR;
+                    }
+                }
+            }
+            UpdateTextureRec(level_textures[level], visible, pixels.data());
+            uploaded_sequence = frame.sequence;
+            uploaded_level = level;
+            uploaded_rect = visible;
+        }
+
+        if (!sim.running && IsKeyPressed(KEY_LEFT))
+            sim.seek(std::max(frame.generation - 1, frame.history_begin));
+        else if (!sim.running && IsKeyPressed(KEY_RIGHT))
+            sim.seek(std::min(frame.generation + 1, frame.history_end));
+
+        if (IsKeyPressed(KEY_R))
+            status = save_pattern_file(frame, "./board.rle");
+        else if (IsKeyPressed(KEY_M))
+            status = save_pattern_file(frame, "./board.mc");
+        else if (IsKeyPressed(KEY_P))
+            status = save_pattern_file(frame, "./board.cells");
 
         BeginDrawing();
         {
             ClearBackground(BG_COLOR);
             // Draw squares
-            for (int sy = 0; sy < BOARD_H; ++sy)
-                for (int sx = 0; sx < BOARD_W; ++sx)
-                    if (board[sy][sx])
-                        DrawRectangle(sx * SQUARE_SIZE, sy * SQUARE_SIZE,
-                                    SQUARE_SIZE, SQUARE_SIZE, ACTIVE_COLOR);
-            // Draw horizontal lines
-            for (int y = 0; y <= WINDOW_H; y += SQUARE_SIZE)
-                DrawLine(0, y, WINDOW_W, y, BORDER_COLOR);
-            // Draw vertical lines
-            for (int x = 0; x <= WINDOW_W; x += SQUARE_SIZE)
-                DrawLine(x, 0, x, WINDOW_H, BORDER_COLOR);
+            float scale = block * zoom;
+            DrawTexturePro(level_textures[level], visible,
+                           Rectangle { (bx0 * block - view.x) * zoom,
+                                       (by0 * block - view.y) * zoom,
+                                       visible.width * scale,
+                                       visible.height * scale },
+                           Vector2 { 0, 0 }, 0, WHITE);
+            // Draw grid lines over the cells in view
+            if (zoom >= MIN_GRID_ZOOM) {
+                int cx0 = std::clamp(int(std::floor(view.x)), 0, BOARD_W);
+                int cy0 = std::clamp(int(std::floor(view.y)), 0, BOARD_H);
+                int cx1 = std::clamp(int(std::ceil(view.x + WINDOW_W / zoom)),
+                                     cx0, BOARD_W);
+                int cy1 = std::clamp(int(std::ceil(view.y + WINDOW_H / zoom)),
+                                     cy0, BOARD_H);
+                DrawTextureRec(grid_texture,
+                               Rectangle { 0, 0, (cx1 - cx0) * zoom + 1,
+                                           (cy1 - cy0) * zoom + 1 },
+                               Vector2 { (cx0 - view.x) * zoom,
+                                         (cy0 - view.y) * zoom },
+                               WHITE);
+            }
+            // Draw simulation stats
+            float target = sim.target_rate;
+            DrawText(TextFormat("rule: %s, topology: %s, generation: %lld, "
+                                "active tiles: %d/%d",
+                                frame.rule.c_str(),
+                                topology_name(frame.topology), frame.generation,
+                                frame.active_tiles,
+                                sim.life.tiles_w * sim.life.tiles_h),
+                     10, 10, 20, TEXT_COLOR);
+            if (target > 0)
+                DrawText(TextFormat("gens/s: %.1f (target: %.0f)", rate, target),
+                         10, 35, 20, TEXT_COLOR);
+            else
+                DrawText(TextFormat("gens/s: %.1f (target: max)", rate),
+                         10, 35, 20, TEXT_COLOR);
+            const char *action = (sim.on_stable == STABLE_PAUSE) ? "pause"
+                                                                 : "fast-forward";
+            if (frame.period == 1)
+                DrawText(TextFormat("still life since generation %lld (%s)",
+                                    frame.stable_generation, action),
+                         10, 60, 20, TEXT_COLOR);
+            else if (frame.period)
+                DrawText(TextFormat("period %d since generation %lld (%s)",
+                                    frame.period, frame.stable_generation,
+                                    action),
+                         10, 60, 20, TEXT_COLOR);
+            else
+                DrawText(TextFormat("not periodic (%s)", action),
+                         10, 60, 20, TEXT_COLOR);
+            DrawText(status, 10, 85, 20, TEXT_COLOR);
+            if (!sim.running && frame.history_end > frame.history_begin) {
+                float value = GuiSliderBar(
+                    TIMELINE_BOUNDS, TextFormat("%lld", frame.history_begin),
+                    TextFormat("%lld", frame.history_end),
+                    float(frame.generation), float(frame.history_begin),
+                    float(frame.history_end));
+                if (on_timeline && IsMouseButtonDown(MOUSE_BUTTON_LEFT) &&
+                    (long long)(value + 0.5f) != frame.generation)
+                    sim.seek((long long)(value + 0.5f));
+            }
         }
         EndDrawing();
-
-        // Update frame only after timeout
-        if (timeout <= 0) {
-            timeout = 0.1;
-        } else {
-            timeout -= GetFrameTime();
-            continue;
-        }
-
-        if (is_running)
-            update_board();
     }
+    sim.stop();
+    for (Texture2D &texture : level_textures)
+        UnloadTexture(texture);
+    UnloadTexture(grid_texture);
     CloseWindow();
 
     return 0;
@@ -0,0 +1,596 @@
+#include "pattern.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+
+const int RLE_LINE_LENGTH = 70;
+// Patterns reaching past this many cells across or down are rejected
+// rather than allocated, far above any board we simulate
+const int MAX_PATTERN_SIZE = 1 << 16;
+// Patterns with more live cells than this fail to load, four times a full
+// 1024x1024 board
+const size_t MAX_PATTERN_CELLS = 1 << 22;
+
+// Buffered character stream over a file or an in-memory string
+struct reader_t {
+    std::FILE *file;
+    const char *data;
+    size_t pos, len;
+    char buf[1 << 16];
+
+    reader_t(std::FILE *file) : file(file), data(buf), pos(0), len(0) {}
+    reader_t(const std::string &text)
+        : file(nullptr), data(text.data()), pos(0), len(text.size()) {}
+
+    int peek()
+    {
+        if (pos == len) {
+            if (!file)
+                return EOF;
+            len = std::fread(buf, 1, sizeof(buf), file);
+            pos = 0;
+            if (len == 0)
+                return EOF;
+        }
+        return (unsigned char)data[pos];
+    }
+
+    int get()
+    {
+        int c = peek();
+        if (c != EOF)
+            pos++;
+        return c;
+    }
+
+    void skip_line()
+    {
+        int c;
+        while ((c = get()) != EOF && c != '\n')
+            ;
+    }
+
+    void skip_spaces()
+    {
+        while (peek() == ' ' || peek() == '\t' || peek() == '\r')
+            get();
+    }
+
+    bool read_number(long long *value)
+    {
+        skip_spaces();
+        if (!isdigit(peek()))
+            return false;
+        *value = 0;
+        while (isdigit(peek())) {
+            if (*value > (LLONG_MAX - 9) / 10)
+                return false;
+            *value = *value * 10 + (get() - '0');
+        }
+        return true;
+    }
+
+    // Reads up to a comma or the end of the line
+    void read_token(std::string *token)
+    {
+        skip_spaces();
+        token->clear();
+        while (peek() != EOF && peek() != ',' && !isspace(peek()))
+            token->push_back(char(get()));
+    }
+};
+
+// Both fail once the pattern would hold more than MAX_PATTERN_CELLS
+static bool add_cells(pattern_t *pattern, int x, int y, int count,
+                      uint8_t state)
+{
+    if (pattern->cells.size() + count > MAX_PATTERN_CELLS)
+        return false;
+    for (int i = 0; i < count; ++i)
+        pattern->cells.push_back(pattern_cell_t { x + i, y, state });
+    return true;
+}
+
+static bool add_cell(pattern_t *pattern, int x, int y, uint8_t state)
+{
+    return add_cells(pattern, x, y, 1, state);
+}
+
+static bool parse_rle(reader_t &in, pattern_t *pattern)
+{
+    // Comments and the "x = 3, y = 3, rule = B3/S23" header
+    for (;;) {
+        in.skip_spaces();
+        int c = in.peek();
+        if (c == '#') {
+            in.get();
+            if (in.get() == 'r')
+                in.read_token(&pattern->rule);
+            in.skip_line();
+        } else if (c == '\n') {
+            in.get();
+        } else {
+            break;
+        }
+    }
+    if (in.peek() == 'x') {
+        while (in.peek() != '\n' && in.peek() != EOF) {
+            char key[8] = {0};
+            int len = 0;
+            in.skip_spaces();
+            while (isalpha(in.peek()) && len < 7)
+                key[len++] = char(in.get());
+            in.skip_spaces();
+            if (in.get() != '=')
+                return false;
+            long long value = 0;
+            bool size = key == std::string("x") || key == std::string("y");
+            if (size && (!in.read_number(&value) || value > MAX_PATTERN_SIZE))
+                return false;
+            if (key == std::string("x"))
+                pattern->width = int(value);
+            else if (key == std::string("y"))
+                pattern->height = int(value);
+            else if (key == std::string("rule"))
+                in.read_token(&pattern->rule);
+            while (in.peek() != ',' && in.peek() != '\n' && in.peek() != EOF)
+                in.get();
+            if (in.peek() == ',')
+                in.get();
+        }
+    }
+
+    // Body: <run><tag> items, "b" or "." dead, "o" or "A".."X" alive (with a
+    // "p".."y" prefix for states above 24), "$" ends a row, "!" the pattern
+    int run = 0;
+    int x = 0, y = 0, prefix = 0;
+    for (int c = in.get(); c != EOF && c != '!'; c = in.get()) {
+        if (isdigit(c)) {
+            run = run * 10 + (c - '0');
+            if (run > MAX_PATTERN_SIZE)
+                return false;
+            continue;
+        }
+        if (isspace(c))
+            continue;
+        if (c == '#') {
+            in.skip_line();
+            continue;
+        }
+        if (c >= 'p' && c <= 'y') {
+            prefix = c - 'p' + 1;
+            continue;
+        }
+        int count = run ? run : 1;
+        run = 0;
+        // Runs fill up to x + count - 1, but "$" moves to row y + count
+        if (c == '$' ? y + count >= MAX_PATTERN_SIZE
+                     : x + count > MAX_PATTERN_SIZE)
+            return false;
+        if (c == 'b' || c == '.') {
+            x += count;
+        } else if (c == '$') {
+            y += count;
+            x = 0;
+        } else if (c >= 'A' && c <= 'X') {
+            if (!add_cells(pattern, x, y, count,
+                           uint8_t(std::min(prefix * 24 + c - 'A' + 1, 255))))
+                return false;
+            x += count;
+        } else {
+            if (!add_cells(pattern, x, y, count, 1))
+                return false;
+            x += count;
+        }
+        prefix = 0;
+    }
+    return true;
+}
+
+static bool parse_plaintext(reader_t &in, pattern_t *pattern)
+{
+    int x = 0, y = 0;
+    for (int c = in.get(); c != EOF; c = in.get()) {
+        if (c == '!' && x == 0) {
+            in.skip_line();
+        } else if (c == '\n') {
+            y++;
+            x = 0;
+        } else if (c == 'O' || c == '*') {
+            if (x >= MAX_PATTERN_SIZE || y >= MAX_PATTERN_SIZE ||
+                !add_cell(pattern, x++, y, 1))
+                return false;
+        } else if (c != '\r') {
+            x++;
+        }
+    }
+    return true;
+}
+
+// Macrocell node: a level 3 leaf is an 8x8 bitmap, a level 1 node holds
+// four cell states and any other level holds four child node indices
+struct mc_node_t {
+    int level;
+    long long child[4];
+    uint64_t bits;
+};
+
+// Fails once the pattern holds too many cells
+static bool expand_macrocell(const std::vector<mc_node_t> &nodes,
+                             long long index, int x, int y,
+                             pattern_t *pattern)
+{
+    if (index == 0 || x >= MAX_PATTERN_SIZE || y >= MAX_PATTERN_SIZE)
+        return true;
+    const mc_node_t &node = nodes[index];
+    if (node.level == 3 && node.bits) {
+        for (int i = 0; i < 64; ++i)
+            if (node.bits >> i & 1 && !add_cell(pattern, x + i % 8, y + i / 8, 1))
+                return false;
+    } else if (node.level == 1) {
+        for (int i = 0; i < 4; ++i)
+            if (node.child[i] &&
+                !add_cell(pattern, x + i % 2, y + i / 2,
+                          uint8_t(std::min(node.child[i], 255LL))))
+                return false;
+    } else {
+        int half = 1 << (node.level - 1);
+        for (int i = 0; i < 4; ++i)
+            if (!expand_macrocell(nodes, node.child[i], x + half * (i % 2),
+                                  y + half * (i / 2), pattern))
+                return false;
+    }
+    return true;
+}
+
+static bool parse_macrocell(reader_t &in, pattern_t *pattern)
+{
+    // Node 0 is the empty node of any level
+    std::vector<mc_node_t> nodes(1);
+    for (int c = in.peek(); c != EOF; c = in.peek()) {
+        if (c == '[') {
+            in.skip_line();
+        } else if (c == '#') {
+            in.get();
+            if (in.get() == 'R')
+                in.read_token(&pattern->rule);
+            in.skip_line();
+        } else if (isspace(c)) {
+            in.get();
+        } else if (c == '.' || c == '*' || c == '$') {
+            mc_node_t leaf = { 3, { 0, 0, 0, 0 }, 0 };
+            int x = 0, y = 0;
+            while ((c = in.get()) != EOF && c != '\n') {
+                if (c == '$') {
+                    y++;
+                    x = 0;
+                } else if (c == '*' && x < 8 && y < 8) {
+                    leaf.bits |= 1ULL << (y * 8 + x++);
+                } else {
+                    x++;
+                }
+            }
+            nodes.push_back(leaf);
+        } else if (isdigit(c)) {
+            mc_node_t node = { 0, { 0, 0, 0, 0 }, 0 };
+            long long level = 0;
+            in.read_number(&level);
+            if (level < 1 || level > 30 || 1 << level > MAX_PATTERN_SIZE)
+                return false;
+            node.level = int(level);
+            // Children are a level down, so a node covers exactly its square
+            for (int i = 0; i < 4; ++i) {
+                if (!in.read_number(&node.child[i]))
+                    return false;
+                if (level > 1 && node.child[i] &&
+                    (node.child[i] >= (long long)nodes.size() ||
+                     nodes[node.child[i]].level != level - 1))
+                    return false;
+            }
+            in.skip_line();
+            nodes.push_back(node);
+        } else {
+            return false;
+        }
+    }
+    if (nodes.size() > 1 &&
+        !expand_macrocell(nodes, nodes.size() - 1, 0, 0, pattern))
+        return false;
+
+    // Macrocell has no bounding box, so move the cells to the origin
+    int min_x = INT_MAX, min_y = INT_MAX;
+    for (const pattern_cell_t &cell : pattern->cells) {
+        min_x = std::min(min_x, cell.x);
+        min_y = std::min(min_y, cell.y);
+    }
+    for (pattern_cell_t &cell : pattern->cells) {
+        cell.x -= min_x;
+        cell.y -= min_y;
+    }
+    return true;
+}
+
+pattern_format_t pattern_format(const std::string &filename)
+{
+    auto ends_with = [&](const std::string &suffix) {
+        return filename.size() >= suffix.size() &&
+               filename.compare(filename.size() - suffix.size(),
+                                suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".mc"))
+        return FORMAT_MACROCELL;
+    if (ends_with(".cells"))
+        return FORMAT_PLAINTEXT;
+    return FORMAT_RLE;
+}
+
+static bool parse_pattern(reader_t &in, pattern_format_t format,
+                          pattern_t *pattern)
+{
+    *pattern = pattern_t { 0, 0, "", {} };
+    bool ok;
+    if (format == FORMAT_MACROCELL || in.peek() == '[')
+        ok = parse_macrocell(in, pattern);
+    else if (format == FORMAT_PLAINTEXT)
+        ok = parse_plaintext(in, pattern);
+    else
+        ok = parse_rle(in, pattern);
+
+    for (const pattern_cell_t &cell : pattern->cells) {
+        pattern->width = std::max(pattern->width, cell.x + 1);
+        pattern->height = std::max(pattern->height, cell.y + 1);
+    }
+    return ok;
+}
+
+bool load_pattern(const std::string &filename, pattern_t *pattern)
+{
+    std::FILE *file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+        return false;
+    reader_t in(file);
+    bool ok = parse_pattern(in, pattern_format(filename), pattern);
+    std::fclose(file);
+    return ok;
+}
+
+bool read_pattern(const std::string &text, pattern_format_t format,
+                  pattern_t *pattern)
+{
+    reader_t in(text);
+    return parse_pattern(in, format, pattern);
+}
+
+static bool is_multistate(const pattern_t &pattern)
+{
+    for (const pattern_cell_t &cell : pattern.cells)
+        if (cell.state > 1)
+            return true;
+    return false;
+}
+
+static std::vector<pattern_cell_t> sorted_cells(const pattern_t &pattern)
+{
+    std::vector<pattern_cell_t> cells = pattern.cells;
+    std::sort(cells.begin(), cells.end(),
+              [](const pattern_cell_t &a, const pattern_cell_t &b) {
+                  return a.y != b.y ? a.y < b.y : a.x < b.x;
+              });
+    return cells;
+}
+
+// Writes "<count><tag>" items wrapped at the RLE line length
+struct rle_writer_t {
+    std::FILE *out;
+    int column;
+
+    void put(long long count, const char *tag)
+    {
+        char item[32];
+        int len;
+        if (count > 1)
+            len = snprintf(item, sizeof(item), "%lld%s", count, tag);
+        else
+            len = snprintf(item, sizeof(item), "%s", tag);
+        if (column + len > RLE_LINE_LENGTH) {
+            std::fputc('\n', out);
+            column = 0;
+        }
+        std::fputs(item, out);
+        column += len;
+    }
+};
+
+static void write_rle(std::FILE *out, const pattern_t &pattern)
+{
+    std::vector<pattern_cell_t> cells = sorted_cells(pattern);
+    bool multistate = is_multistate(pattern);
+    std::fprintf(out, "x = %d, y = %d, rule = %s\n", pattern.width,
+                 pattern.height,
+                 pattern.rule.empty() ? "B3/S23" : pattern.rule.c_str());
+
+    rle_writer_t writer = { out, 0 };
+    int x = 0, y = 0;
+    for (size_t i = 0; i < cells.size(); ++i) {
+        const pattern_cell_t &cell = cells[i];
+        if (cell.y > y) {
+            writer.put(cell.y - y, "$");
+            y = cell.y;
+            x = 0;
+        }
+        if (cell.x > x)
+            writer.put(cell.x - x, multistate ? "." : "b");
+        size_t j = i;
+        while (j + 1 < cells.size() && cells[j + 1].y == cell.y &&
+               cells[j + 1].x == cells[j].x + 1 &&
+               cells[j + 1].state == cell.state)
+            j++;
+
+        char tag[3] = { 'o', 0, 0 };
+        if (multistate) {
+            int state = cell.state - 1;
+            if (state >= 24) {
+                tag[0] = char('p' + state / 24 - 1);
+                tag[1] = char('A' + state % 24);
+            } else {
+                tag[0] = char('A' + state);
+            }
+        }
+        writer.put(j - i + 1, tag);
+        x = cells[j].x + 1;
+        i = j;
+    }
+    writer.put(1, "!");
+    std::fputc('\n', out);
+}
+
+static void write_plaintext(std::FILE *out, const pattern_t &pattern)
+{
+    std::vector<pattern_cell_t> cells = sorted_cells(pattern);
+    int x = 0, y = 0;
+    for (const pattern_cell_t &cell : cells) {
+        for (; y < cell.y; ++y, x = 0)
+            std::fputc('\n', out);
+        for (; x < cell.x; ++x)
+            std::fputc('.', out);
+        std::fputc('O', out);
+        x++;
+    }
+    if (!cells.empty())
+        std::fputc('\n', out);
+}
+
+// Builds the quadtree bottom-up, writing each distinct node the first time
+// it is seen so that children always precede their parents
+struct mc_writer_t {
+    std::FILE *out;
+    bool multistate;
+    long long count;
+    std::unordered_map<uint64_t, long long> leaves;
+    std::map<std::array<long long, 5>, long long> nodes;
+
+    long long write_leaf(uint64_t bits)
+    {
+        auto it = leaves.find(bits);
+        if (it != leaves.end())
+            return it->second;
+        int rows = 8;
+        while (rows > 0 && !(bits >> ((rows - 1) * 8) & 0xff))
+            rows--;
+        for (int y = 0; y < rows; ++y) {
+            int row = bits >> (y * 8) & 0xff;
+            for (int x = 0; row >> x; ++x)
+                std::fputc(row >> x & 1 ? '*' : '.', out);
+            std::fputc('$', out);
+        }
+        std::fputc('\n', out);
+        return leaves[bits] = ++count;
+    }
+
+    long long write_node(const std::array<long long, 5> &key)
+    {
+        auto it = nodes.find(key);
+        if (it != nodes.end())
+            return it->second;
+        std::fprintf(out, "%lld %lld %lld %lld %lld\n",
+                     key[0], key[1], key[2], key[3], key[4]);
+        return nodes[key] = ++count;
+    }
+
+    long long build(int level, int x0, int y0,
+                    pattern_cell_t *begin, pattern_cell_t *end)
+    {
+        if (begin == end)
+            return 0;
+        if (!multistate && level == 3) {
+            uint64_t bits = 0;
+            for (pattern_cell_t *cell = begin; cell != end; ++cell)
+                bits |= 1ULL << ((cell->y - y0) * 8 + (cell->x - x0));
+            return write_leaf(bits);
+        }
+        std::array<long long, 5> key = { level, 0, 0, 0, 0 };
+        if (level == 1) {
+            for (pattern_cell_t *cell = begin; cell != end; ++cell)
+                key[1 + (cell->y - y0) * 2 + (cell->x - x0)] = cell->state;
+            return write_node(key);
+        }
+        int half = 1 << (level - 1);
+        auto is_top = [&](const pattern_cell_t &c) { return c.y < y0 + half; };
+        auto is_left = [&](const pattern_cell_t &c) { return c.x < x0 + half; };
+        pattern_cell_t *mid = std::partition(begin, end, is_top);
+        pattern_cell_t *top_mid = std::partition(begin, mid, is_left);
+        pattern_cell_t *bottom_mid = std::partition(mid, end, is_left);
+        key[1] = build(level - 1, x0, y0, begin, top_mid);
+        key[2] = build(level - 1, x0 + half, y0, top_mid, mid);
+        key[3] = build(level - 1, x0, y0 + half, mid, bottom_mid);
+        key[4] = build(level - 1, x0 + half, y0 + half, bottom_mid, end);
+        return write_node(key);
+    }
+};
+
+static void write_macrocell(std::FILE *out, const pattern_t &pattern)
+{
+    std::vector<pattern_cell_t> cells = pattern.cells;
+    bool multistate = is_multistate(pattern);
+    std::fprintf(out, "[M2] (creative-coding)\n");
+    std::fprintf(out, "#R %s\n",
+                 pattern.rule.empty() ? "B3/S23" : pattern.rule.c_str());
+
+    int level = multistate ? 1 : 3;
+    while ((1LL << level) < std::max(pattern.width, pattern.height))
+        level++;
+    mc_writer_t writer = { out, multistate, 0, {}, {} };
+    long long root = writer.build(level, 0, 0, cells.data(),
+                                  cells.data() + cells.size());
+    // An empty pattern still needs a root node
+    if (root == 0)
+        std::fprintf(out, "%d 0 0 0 0\n", level + 1);
+}
+
+bool save_pattern(const std::string &filename, const pattern_t &pattern)
+{
+    std::FILE *file = std::fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+    switch (pattern_format(filename)) {
+    case FORMAT_RLE:
+        write_rle(file, pattern);
+        break;
+    case FORMAT_MACROCELL:
+        write_macrocell(file, pattern);
+        break;
+    case FORMAT_PLAINTEXT:
+        write_plaintext(file, pattern);
+        break;
+    }
+    return std::fclose(file) == 0;
+}
+
+pattern_t pattern_from_cells(const std::vector<uint8_t> &cells,
+                             int width, int height)
+{
+    pattern_t pattern = { 0, 0, "", {} };
+    int min_x = width, min_y = height;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t state = cells[y * width + x];
+            if (!state)
+                continue;
+            pattern.cells.push_back(pattern_cell_t { x, y, state });
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+        }
+    }
+    // Crop to the bounding box of live cells
+    for (pattern_cell_t &cell : pattern.cells) {
+        cell.x -= min_x;
+        cell.y -= min_y;
+        pattern.width = std::max(pattern.width, cell.x + 1);
+        pattern.height = std::max(pattern.height, cell.y + 1);
+    }
+    return pattern;
+}
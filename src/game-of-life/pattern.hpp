@@ -0,0 +1,40 @@
+#ifndef PATTERN_HPP
+#define PATTERN_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum pattern_format_t {
+    FORMAT_RLE,
+    FORMAT_MACROCELL,
+    FORMAT_PLAINTEXT,
+};
+
+struct pattern_cell_t {
+    int x, y;
+    uint8_t state;
+};
+
+// Live cells of a pattern, relative to the top left corner of its bounding
+// box. Dead cells are not stored.
+struct pattern_t {
+    int width, height;
+    std::string rule;
+    std::vector<pattern_cell_t> cells;
+};
+
+// Guess the format from the file extension (.rle, .mc, .cells)
+pattern_format_t pattern_format(const std::string &filename);
+
+// Parsers read the file through a fixed-size buffer and emit cells as they
+// go, so large files are never held in memory as text
+bool load_pattern(const std::string &filename, pattern_t *pattern);
+bool read_pattern(const std::string &text, pattern_format_t format,
+                  pattern_t *pattern);
+bool save_pattern(const std::string &filename, const pattern_t &pattern);
+
+pattern_t pattern_from_cells(const std::vector<uint8_t> &cells,
+                             int width, int height);
+
+#endif // PATTERN_HPP
@@ -0,0 +1,197 @@
+#include "rule.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+const int MAX_LTL_RADIUS = 100;
+
+static void compile(rule_t *rule, const std::vector<bool> &birth,
+                    const std::vector<bool> &survive)
+{
+    rule->stride = int(birth.size());
+    rule->table.assign(rule->states * rule->stride, 0);
+    uint8_t dying = rule->states > 2 ? 2 : 0;
+    for (int count = 0; count < rule->stride; ++count) {
+        rule->table[count] = birth[count] ? 1 : 0;
+        rule->table[rule->stride + count] = survive[count] ? 1 : dying;
+        for (int state = 2; state < rule->states; ++state)
+            rule->table[state * rule->stride + count] =
+                (state + 1 < rule->states) ? state + 1 : 0;
+    }
+}
+
+static std::string digits(const std::vector<bool> &counts)
+{
+    std::string result;
+    for (int i = 0; i < int(counts.size()); ++i)
+        if (counts[i])
+            result += char('0' + i);
+    return result;
+}
+
+static bool parse_digits(const std::string &text, std::vector<bool> *counts)
+{
+    for (char c : text) {
+        if (c < '0' || c > '8')
+            return false;
+        (*counts)[c - '0'] = true;
+    }
+    return true;
+}
+
+static bool parse_states(const std::string &text, int *states)
+{
+    if (text.empty() || text.size() > 3)
+        return false;
+    for (char c : text)
+        if (!isdigit(c))
+            return false;
+    *states = std::atoi(text.c_str());
+    // C0 and C1 are accepted as aliases for two states
+    if (*states < 2)
+        *states = 2;
+    return *states <= 256;
+}
+
+// R5,C0,M1,S34..58,B34..45,NM
+static bool parse_ltl(const std::string &text, rule_t *rule)
+{
+    int radius = 0, states = 2, middle = 0;
+    int s_min = 1, s_max = 0, b_min = 1, b_max = 0;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.size() < 2)
+            return false;
+        char key = item[0];
+        std::string value = item.substr(1);
+        if (key == 'R') {
+            radius = std::atoi(value.c_str());
+        } else if (key == 'C') {
+            if (!parse_states(value, &states))
+                return false;
+        } else if (key == 'M') {
+            middle = std::atoi(value.c_str());
+        } else if (key == 'S' || key == 'B') {
+            size_t dots = value.find("..");
+            if (dots == std::string::npos)
+                return false;
+            int lo = std::atoi(value.substr(0, dots).c_str());
+            int hi = std::atoi(value.substr(dots + 2).c_str());
+            if (key == 'S') {
+                s_min = lo;
+                s_max = hi;
+            } else {
+                b_min = lo;
+                b_max = hi;
+            }
+        } else if (key == 'N') {
+            // Only the Moore neighbourhood is supported
+            if (value != "M")
+                return false;
+        } else {
+            return false;
+        }
+    }
+    if (radius < 1 || radius > MAX_LTL_RADIUS)
+        return false;
+
+    int side = 2 * radius + 1;
+    std::vector<bool> birth(side * side + 1, false);
+    std::vector<bool> survive(side * side + 1, false);
+    for (int i = std::max(b_min, 0); i <= b_max && i <= side * side; ++i)
+        birth[i] = true;
+    for (int i = std::max(s_min, 0); i <= s_max && i <= side * side; ++i)
+        survive[i] = true;
+
+    rule->states = states;
+    rule->radius = radius;
+    rule->middle = middle != 0;
+    compile(rule, birth, survive);
+    rule->name = "R" + std::to_string(radius) +
+                 ",C" + std::to_string(states == 2 ? 0 : states) +
+                 ",M" + std::to_string(middle != 0) +
+                 ",S" + std::to_string(s_min) + ".." + std::to_string(s_max) +
+                 ",B" + std::to_string(b_min) + ".." + std::to_string(b_max) +
+                 ",NM";
+    return true;
+}
+
+// B3/S23, 23/3 (S/B), B2/S/C3 and /2/3 (S/B/C)
+static bool parse_totalistic(const std::string &text, rule_t *rule)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, '/'))
+        parts.push_back(part);
+    if (!text.empty() && text.back() == '/')
+        parts.push_back("");
+    if (parts.size() < 2 || parts.size() > 3)
+        return false;
+
+    std::vector<bool> birth(9, false), survive(9, false);
+    int states = 2;
+    bool has_birth = false, has_survive = false;
+    for (int i = 0; i < int(parts.size()); ++i) {
+        const std::string &p = parts[i];
+        char key = p.empty() ? 0 : p[0];
+        if (key == 'B') {
+            has_birth = parse_digits(p.substr(1), &birth);
+            if (!has_birth)
+                return false;
+        } else if (key == 'S') {
+            has_survive = parse_digits(p.substr(1), &survive);
+            if (!has_survive)
+                return false;
+        } else if (key == 'C' || key == 'G') {
+            if (!parse_states(p.substr(1), &states))
+                return false;
+        } else if (i == 2) {
+            if (!parse_states(p, &states))
+                return false;
+        } else if (i == 0 && !parse_digits(p, &survive)) {
+            return false;
+        } else if (i == 1 && !parse_digits(p, &birth)) {
+            return false;
+        }
+    }
+    // Mixing lettered and bare S/B parts is ambiguous
+    if (has_birth != has_survive)
+        return false;
+
+    rule->states = states;
+    rule->radius = 1;
+    rule->middle = false;
+    compile(rule, birth, survive);
+    rule->name = "B" + digits(birth) + "/S" + digits(survive);
+    if (states > 2)
+        rule->name += "/C" + std::to_string(states);
+    return true;
+}
+
+bool parse_rule(const std::string &text, rule_t *rule)
+{
+    std::string upper;
+    for (char c : text)
+        if (!isspace((unsigned char)c))
+            upper += char(toupper((unsigned char)c));
+
+    rule_t parsed;
+    bool ok;
+    if (!upper.empty() && upper[0] == 'R' && upper.find(',') != std::string::npos)
+        ok = parse_ltl(upper, &parsed);
+    else
+        ok = parse_totalistic(upper, &parsed);
+    if (ok)
+        *rule = parsed;
+    return ok;
+}
+
+rule_t conway_rule()
+{
+    rule_t rule;
+    parse_rule("B3/S23", &rule);
+    return rule;
+}
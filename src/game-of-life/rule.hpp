@@ -0,0 +1,40 @@
+#ifndef RULE_HPP
+#define RULE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Outer-totalistic rule compiled to a lookup table of the next state,
+// indexed by the current state and the number of live (state 1) cells in
+// the neighbourhood. Covers:
+//   Life-like    B3/S23, 23/3
+//   Generations  B2/S/C3, /2/3  (states above 1 are dying cells)
+//   Larger than Life  R5,C0,M1,S34..58,B34..45,NM
+struct rule_t {
+    std::string name;
+    int states;
+    // Moore neighbourhood radius, above 1 the neighbours are counted with a
+    // summed-area table
+    int radius;
+    // The count includes the cell itself
+    bool middle;
+    int stride;
+    std::vector<uint8_t> table;
+
+    uint8_t next(uint8_t state, int count) const
+    {
+        return table[state * stride + count];
+    }
+
+    // Dead cells come alive with no neighbours, so empty regions change
+    bool births_on_zero() const
+    {
+        return table[0] != 0;
+    }
+};
+
+bool parse_rule(const std::string &text, rule_t *rule);
+rule_t conway_rule();
+
+#endif // RULE_HPP
@@ -0,0 +1,301 @@
+#include "simulation.hpp"
+#include <algorithm>
+#include <chrono>
+
+using clock_type = std::chrono::steady_clock;
+
+// Tiles flagged with a dirty bit, in order, clearing the bit
+static void take_dirty(life_t &life, uint8_t bit, std::vector<int> *tiles)
+{
+    tiles->clear();
+    for (int tile = 0; tile < life.tiles_w * life.tiles_h; ++tile) {
+        if (life.dirty[tile] & bit) {
+            life.dirty[tile] &= ~bit;
+            tiles->push_back(tile);
+        }
+    }
+}
+
+// Cells x0 up to x1 and y0 up to y1 covered by a tile
+static void tile_bounds(const life_t &life, int tile, int *x0, int *y0,
+                        int *x1, int *y1)
+{
+    *x0 = tile % life.tiles_w * TILE_SIZE;
+    *y0 = tile / life.tiles_w * TILE_SIZE;
+    *x1 = std::min(*x0 + TILE_SIZE, life.width);
+    *y1 = std::min(*y0 + TILE_SIZE, life.height);
+}
+
+// Copy a tile into a board laid out as by life_t::copy_cells()
+static void copy_tile(const life_t &life, int tile, std::vector<uint8_t> *cells)
+{
+    int x0, y0, x1, y1;
+    tile_bounds(life, tile, &x0, &y0, &x1, &y1);
+    for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; ++x)
+            (*cells)[size_t(y) * life.width + x] = life.get(x, y);
+}
+
+// Rows of the tiles in board order, joining neighbouring tiles
+static void tile_spans(const life_t &life, const std::vector<int> &tiles,
+                       std::vector<span_t> *spans)
+{
+    spans->clear();
+    for (size_t row = 0; row < tiles.size();) {
+        // Tiles sharing a tile row are interleaved row by row
+        int ty = tiles[row] / life.tiles_w;
+        size_t row_end = row;
+        while (row_end < tiles.size() && tiles[row_end] / life.tiles_w == ty)
+            row_end++;
+        int rows_end = std::min((ty + 1) * TILE_SIZE, life.height);
+        for (int y = ty * TILE_SIZE; y < rows_end; ++y) {
+            for (size_t i = row; i < row_end; ++i) {
+                int x0, y0, x1, y1;
+                tile_bounds(life, tiles[i], &x0, &y0, &x1, &y1);
+                size_t begin = size_t(y) * life.width + x0;
+                size_t end = size_t(y) * life.width + x1;
+                if (!spans->empty() && spans->back().end == begin)
+                    spans->back().end = end;
+                else
+                    spans->push_back(span_t { begin, end });
+            }
+        }
+        row = row_end;
+    }
+}
+
+simulation_t::simulation_t(int width, int height)
+    : life(width, height), running(false), target_rate(10),
+      on_stable(STABLE_PAUSE), generation(0),
+      middle(1), front(0), back(2), published(0), sequence(0), quit(false),
+      pattern_pending(false), rule_pending(false), topology_pending(false),
+      topology(TOPOLOGY_DEAD), stroke_pending(false), history_move(0),
+      seek_generation(-1), snapshot(size_t(width) * height),
+      density(width, height)
+{
+    density.update(life);
+    for (frame_t &frame : frames) {
+        frame = frame_t { {}, density.levels, 0, 0, 0, life.rule.name,
+                          life.rule.states, life.topology, 0, 0, 0, 0, 0, 0 };
+        life.copy_cells(&frame.cells);
+    }
+}
+
+simulation_t::~simulation_t()
+{
+    stop();
+}
+
+void simulation_t::start()
+{
+    quit = false;
+    timeline.clear();
+    record();
+    thread = std::thread(&simulation_t::run, this);
+}
+
+void simulation_t::stop()
+{
+    quit = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+void simulation_t::paint(const std::vector<edit_t> &batch)
+{
+    // The board size never changes, so it is safe to read from here
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    for (const edit_t &edit : batch)
+        if (life.is_valid(edit.x, edit.y))
+            edits.push_back(edit);
+}
+
+void simulation_t::end_stroke()
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    stroke_pending = true;
+}
+
+void simulation_t::undo()
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    history_move--;
+}
+
+void simulation_t::redo()
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    history_move++;
+}
+
+void simulation_t::seek(long long generation)
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    seek_generation = generation;
+    history_move = 0;
+}
+
+void simulation_t::load(pattern_t pattern)
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    this->pattern = std::move(pattern);
+    pattern_pending = true;
+    edits.clear();
+}
+
+void simulation_t::set_rule(const rule_t &rule)
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    this->rule = rule;
+    rule_pending = true;
+}
+
+void simulation_t::set_topology(topology_t topology)
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    this->topology = topology;
+    topology_pending = true;
+}
+
+const frame_t &simulation_t::acquire()
+{
+    if (middle.load(std::memory_order_acquire) & FRESH)
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    return frames[front];
+}
+
+bool simulation_t::apply_edits()
+{
+    std::lock_guard<std::mutex> lock(edits_mutex);
+    bool changed = pattern_pending || rule_pending || topology_pending ||
+                   !edits.empty() || history_move || seek_generation >= 0;
+    if (topology_pending) {
+        life.set_topology(topology);
+        topology_pending = false;
+    }
+    // Snapshots are restored with the current rule, so the history is
+    // started over when the rule or the whole board changes
+    if (rule_pending) {
+        life.set_rule(rule);
+        rule_pending = false;
+        timeline.clear();
+        record();
+    }
+    if (pattern_pending) {
+        life.load(pattern);
+        generation = life.generation;
+        pattern = pattern_t {};
+        pattern_pending = false;
+        timeline.clear();
+        record();
+    }
+    for (const edit_t &edit : edits)
+        life.set(edit.x, edit.y, edit.alive);
+    edits.clear();
+    if (stroke_pending) {
+        record();
+        stroke_pending = false;
+    }
+
+    int target = timeline.cursor + history_move;
+    if (seek_generation >= 0)
+        target = timeline.find(seek_generation);
+    if ((history_move || seek_generation >= 0) &&
+        timeline.seek(std::clamp(target, 0, timeline.size() - 1), &snapshot)) {
+        life.restore(snapshot, timeline.generation(timeline.cursor));
+        generation = life.generation;
+    }
+    history_move = 0;
+    seek_generation = -1;
+    return changed;
+}
+
+void simulation_t::publish(bool force)
+{
+    // Copying the changed tiles costs about as much as computing them, so
+    // while the reader still has an unread frame there is no point
+    // replacing it
+    if (!force && (middle.load(std::memory_order_acquire) & FRESH))
+        return;
+    frame_t &frame = frames[back];
+    density.update(life);
+    // Only the tiles changed since this frame was last written are copied,
+    // with the density blocks covering them
+    take_dirty(life, uint8_t(DIRTY_FRAME << back), &tiles);
+    for (int tile : tiles) {
+        copy_tile(life, tile, &frame.cells);
+        int x0, y0, x1, y1;
+        tile_bounds(life, tile, &x0, &y0, &x1, &y1);
+        for (int level = 1; level < density.level_count(); ++level) {
+            int w = density.level_width(level);
+            int bx0 = x0 >> level, bx1 = (x1 - 1) >> level;
+            for (int by = y0 >> level; by <= (y1 - 1) >> level; ++by)
+                std::copy_n(&density.levels[level][by * w + bx0], bx1 - bx0 + 1,
+                            &frame.density[level][by * w + bx0]);
+        }
+    }
+    frame.generation = life.generation;
+    frame.active_tiles = life.active_tiles;
+    frame.sequence = ++sequence;
+    frame.rule = life.rule.name;
+    frame.states = life.rule.states;
+    frame.topology = life.topology;
+    frame.period = life.period;
+    frame.stable_generation = life.stable_generation;
+    frame.history_begin = timeline.generation(0);
+    frame.history_end = timeline.generation(timeline.size() - 1);
+    frame.history_cursor = timeline.cursor;
+    frame.history_size = timeline.size();
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    published = life.generation;
+}
+
+void simulation_t::record()
+{
+    // Only the tiles changed since the last snapshot are copied and diffed
+    take_dirty(life, DIRTY_TIMELINE, &tiles);
+    for (int tile : tiles)
+        copy_tile(life, tile, &snapshot);
+    tile_spans(life, tiles, &spans);
+    timeline.push(snapshot, spans, life.generation);
+}
+
+void simulation_t::run()
+{
+    auto next_step = clock_type::now();
+    while (!quit) {
+        bool edited = apply_edits();
+        if (!running) {
+            if (edited || published != life.generation)
+                publish(true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            next_step = clock_type::now();
+            continue;
+        }
+
+        float rate = target_rate;
+        if (rate > 0) {
+            std::this_thread::sleep_until(next_step);
+            next_step += std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<float>(1 / rate));
+            // Don't try to catch up after falling behind
+            if (next_step < clock_type::now())
+                next_step = clock_type::now();
+        }
+
+        int period = life.period;
+        if (period && on_stable == STABLE_FAST_FORWARD)
+            life.fast_forward(FAST_FORWARD_GENERATIONS);
+        else
+            life.step();
+        generation = life.generation;
+        record();
+        // Pause only when the board becomes periodic, so that it can still
+        // be resumed by hand afterwards
+        if (!period && life.period && on_stable == STABLE_PAUSE) {
+            running = false;
+            edited = true;
+        }
+        publish(edited);
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include "density.hpp"
+#include "life.hpp"
+#include "timeline.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Snapshot of a completed generation handed to the render loop
+struct frame_t {
+    std::vector<uint8_t> cells;
+    // See density_t::levels
+    std::vector<std::vector<uint32_t>> density;
+    long long generation;
+    int active_tiles;
+    // Incremented on every publish, edits included
+    long long sequence;
+    std::string rule;
+    int states;
+    topology_t topology;
+    // See life_t::period
+    int period;
+    long long stable_generation;
+    // Generations that can be scrubbed to, and the position of the board
+    // among the recorded snapshots
+    long long history_begin, history_end;
+    int history_cursor, history_size;
+};
+
+// What the simulation does once the board becomes periodic
+enum stable_action_t {
+    STABLE_PAUSE,
+    // Skip whole periods, so the generation counter races ahead while only
+    // the last few generations of every batch are computed
+    STABLE_FAST_FORWARD,
+};
+
+// Generations advanced per step while fast-forwarding
+const long long FAST_FORWARD_GENERATIONS = 1000;
+
+struct edit_t {
+    int x, y;
+    bool alive;
+};
+
+// Runs Life on its own thread, either as fast as possible or at a target
+// rate. Completed generations are published through a lock-free triple
+// buffer, so the render loop never waits for the simulation and vice versa.
+struct simulation_t {
+    // Owned by the simulation thread while it is started
+    life_t life;
+    std::atomic<bool> running;
+    // Target generations per second, 0 means unlimited
+    std::atomic<float> target_rate;
+    std::atomic<int> on_stable;
+    // Latest computed generation, may be ahead of the published frame
+    std::atomic<long long> generation;
+
+    simulation_t(int width, int height);
+    ~simulation_t();
+
+    void start();
+    void stop();
+    // Queue a batch of cell edits, applied together by the simulation
+    // thread between two generations. Cells off the board are ignored.
+    void paint(const std::vector<edit_t> &batch);
+    // Record the edits painted so far as one undo step
+    void end_stroke();
+    void undo();
+    void redo();
+    // Go back or forward to a recorded generation
+    void seek(long long generation);
+    // Queue a pattern to replace the board, see life_t::load()
+    void load(pattern_t pattern);
+    void set_rule(const rule_t &rule);
+    void set_topology(topology_t topology);
+    // Newest published frame. Must only be called from the render thread.
+    const frame_t &acquire();
+
+private:
+    static const int FRESH = 4;
+    frame_t frames[3];
+    // Index of the frame between writer and reader, FRESH if unread
+    std::atomic<int> middle;
+    int front, back;
+    long long published;
+    long long sequence;
+
+    std::atomic<bool> quit;
+    std::thread thread;
+    std::mutex edits_mutex;
+    std::vector<edit_t> edits;
+    bool pattern_pending;
+    pattern_t pattern;
+    bool rule_pending;
+    rule_t rule;
+    bool topology_pending;
+    topology_t topology;
+    bool stroke_pending;
+    int history_move;
+    long long seek_generation;
+
+    // Owned by the simulation thread
+    timeline_t timeline;
+    // Board as of the last record() or seek, with its changed tiles and
+    // their spans of cells
+    std::vector<uint8_t> snapshot;
+    std::vector<int> tiles;
+    std::vector<span_t> spans;
+    density_t density;
+
+    void run();
+    void record();
+    bool apply_edits();
+    void publish(bool force);
+};
+
+#endif // SIMULATION_HPP
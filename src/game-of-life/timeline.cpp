@@ -0,0 +1,177 @@
+#include "timeline.hpp"
+#include <algorithm>
+
+// Zero runs shorter than this are cheaper to keep inside a literal run
+const int MIN_ZERO_RUN = 3;
+
+static void put_varint(std::vector<uint8_t> *out, size_t value)
+{
+    while (value >= 0x80) {
+        out->push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(uint8_t(value));
+}
+
+static size_t get_varint(const uint8_t **in)
+{
+    size_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *(*in)++;
+        value |= size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+// Encode cells XOR base over the spans, outside of which the two are equal.
+// Base may be null for a keyframe.
+static void encode(const std::vector<uint8_t> &cells, const uint8_t *base,
+                   const std::vector<span_t> &spans, std::vector<uint8_t> *out)
+{
+    // The literal run being built, the zero run before it and the end of
+    // its last non-zero byte
+    std::vector<uint8_t> literals;
+    size_t zeros = 0, end = 0;
+    auto flush = [&]() {
+        put_varint(out, zeros);
+        put_varint(out, literals.size());
+        out->insert(out->end(), literals.begin(), literals.end());
+        literals.clear();
+    };
+    out->clear();
+    for (const span_t &span : spans) {
+        for (size_t i = span.begin; i < span.end; ++i) {
+            uint8_t diff = base ? cells[i] ^ base[i] : cells[i];
+            if (!diff)
+                continue;
+            // A literal run ends at a long enough zero run
+            size_t gap = i - end;
+            if (!literals.empty() && gap < size_t(MIN_ZERO_RUN)) {
+                literals.insert(literals.end(), gap, 0);
+            } else {
+                if (!literals.empty())
+                    flush();
+                zeros = gap;
+            }
+            literals.push_back(diff);
+            end = i + 1;
+        }
+    }
+    if (!literals.empty())
+        flush();
+}
+
+// XOR an encoded snapshot into cells
+static void apply(const std::vector<uint8_t> &data, std::vector<uint8_t> *cells)
+{
+    const uint8_t *in = data.data();
+    const uint8_t *end = in + data.size();
+    size_t i = 0;
+    while (in < end) {
+        i += get_varint(&in);
+        size_t literals = get_varint(&in);
+        for (size_t k = 0; k < literals; ++k)
+            (*cells)[i++] ^= *in++;
+    }
+}
+
+timeline_t::timeline_t() : cursor(-1), bytes(0) {}
+
+void timeline_t::clear()
+{
+    snapshots.clear();
+    last.clear();
+    cursor = -1;
+    bytes = 0;
+}
+
+int timeline_t::size() const
+{
+    return int(snapshots.size());
+}
+
+long long timeline_t::generation(int index) const
+{
+    return snapshots[index].generation;
+}
+
+int timeline_t::find(long long generation) const
+{
+    // Generations never decrease along the timeline
+    auto it = std::upper_bound(snapshots.begin(), snapshots.end(), generation,
+                               [](long long g, const snapshot_t &snapshot) {
+                                   return g < snapshot.generation;
+                               });
+    return std::max(int(it - snapshots.begin()) - 1, 0);
+}
+
+void timeline_t::push(const std::vector<uint8_t> &cells,
+                      const std::vector<span_t> &spans, long long generation)
+{
+    for (int i = cursor + 1; i < size(); ++i)
+        bytes -= snapshots[i].data.capacity();
+    snapshots.resize(cursor + 1);
+
+    int since_keyframe = KEYFRAME_INTERVAL;
+    for (int i = cursor; i >= 0 && cursor - i < KEYFRAME_INTERVAL; --i) {
+        if (snapshots[i].keyframe) {
+            since_keyframe = cursor - i + 1;
+            break;
+        }
+    }
+    bool keyframe = since_keyframe >= KEYFRAME_INTERVAL ||
+                    last.size() != cells.size();
+
+    snapshot_t snapshot = { generation, keyframe, {} };
+    if (keyframe) {
+        encode(cells, nullptr, { { 0, cells.size() } }, &snapshot.data);
+        last = cells;
+    } else {
+        encode(cells, last.data(), spans, &snapshot.data);
+        for (const span_t &span : spans)
+            std::copy(cells.begin() + span.begin, cells.begin() + span.end,
+                      last.begin() + span.begin);
+    }
+    snapshot.data.shrink_to_fit();
+    bytes += snapshot.data.capacity();
+    snapshots.push_back(std::move(snapshot));
+    cursor = size() - 1;
+    drop_oldest();
+}
+
+bool timeline_t::seek(int index, std::vector<uint8_t> *cells)
+{
+    if (index < 0 || index >= size())
+        return false;
+    decode(index, &last);
+    *cells = last;
+    cursor = index;
+    return true;
+}
+
+void timeline_t::decode(int index, std::vector<uint8_t> *cells) const
+{
+    int keyframe = index;
+    while (!snapshots[keyframe].keyframe)
+        keyframe--;
+    cells->assign(last.size(), 0);
+    for (int i = keyframe; i <= index; ++i)
+        apply(snapshots[i].data, cells);
+}
+
+void timeline_t::drop_oldest()
+{
+    while (bytes > MAX_TIMELINE_BYTES) {
+        // The first snapshot is always a keyframe, drop up to the next one
+        int next = 1;
+        while (next < size() && !snapshots[next].keyframe)
+            next++;
+        if (next > cursor)
+            return;
+        for (int i = 0; i < next; ++i)
+            bytes -= snapshots[i].data.capacity();
+        snapshots.erase(snapshots.begin(), snapshots.begin() + next);
+        cursor -= next;
+    }
+}
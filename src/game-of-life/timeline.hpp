@@ -0,0 +1,62 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Every KEYFRAME_INTERVAL-th snapshot stores the whole board
+const int KEYFRAME_INTERVAL = 32;
+// Oldest snapshots are dropped, a keyframe group at a time, past this size
+const size_t MAX_TIMELINE_BYTES = 32 << 20;
+
+// Board stored as the XOR with the previous snapshot (or with an empty
+// board for keyframes), run-length encoded: pairs of a zero run and a
+// literal run, both as varints, each followed by the literal bytes
+struct snapshot_t {
+    long long generation;
+    bool keyframe;
+    std::vector<uint8_t> data;
+};
+
+// Cells begin up to end of a board laid out row by row
+struct span_t {
+    size_t begin, end;
+};
+
+// Bounded history of board states for undo and scrubbing. A snapshot is
+// recorded for every generation and every finished edit, so several
+// snapshots may share a generation.
+struct timeline_t {
+    // Index of the snapshot the board currently shows. Snapshots after it
+    // can be returned to until a new one is recorded.
+    int cursor;
+    size_t bytes;
+
+    timeline_t();
+
+    void clear();
+    int size() const;
+    long long generation(int index) const;
+    // Last snapshot of a generation, or the closest one before it
+    int find(long long generation) const;
+    // Record the board after the cursor, dropping the snapshots past it.
+    // Only the cells in spans, which are in order, may differ from the
+    // board at the cursor, so only those are looked at between keyframes.
+    void push(const std::vector<uint8_t> &cells,
+              const std::vector<span_t> &spans, long long generation);
+    // Rebuild a snapshot from the nearest keyframe before it and move the
+    // cursor there
+    bool seek(int index, std::vector<uint8_t> *cells);
+
+private:
+    std::deque<snapshot_t> snapshots;
+    // Board of the snapshot at the cursor, the base of the next delta
+    std::vector<uint8_t> last;
+
+    void decode(int index, std::vector<uint8_t> *cells) const;
+    void drop_oldest();
+};
+
+#endif // TIMELINE_HPP
@@ -0,0 +1,286 @@
+#define RAYEXT_IMPLEMENTATION
+#include <raylib-ext.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "renderer.hpp"
+#include "stream.hpp"
+
+struct options_t {
+    cast_mode_t cast;
+    grid_layout_t layout;
+    int frames;
+    // Render threads, 0 renders on the main thread without a pool
+    int threads;
+    int width, height;
+    std::string map;
+    // Binary copy of the map to write, if any
+    std::string save;
+    // Memory cap in MB for streaming a binary map in chunks, 0 loads the
+    // whole map
+    int stream_mb;
+    // Sprites scattered over the empty cells, on top of the map's own
+    int sprites;
+};
+
+void usage(const char *name)
+{
+    std::fprintf(stderr,
+        "usage: %s [options] [map file]\n"
+        "  --cast single|packet   ray casting mode (default single)\n"
+        "  --layout rows|tiles    map grid layout (default rows)\n"
+        "  --frames N             frames per run (default 600)\n"
+        "  --threads N            render threads, 0 for none (default 0)\n"
+        "  --size WxH             view size (default 720x720)\n"
+        "  --save FILE            also save the map in the binary format\n"
+        "  --stream MB            stream a binary map within a memory cap\n"
+        "  --sprites N            scatter N sprites over the map (default 0)\n"
+        "map file, text or binary, defaults to ../raycasting/test.map\n",
+        name);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// Text as a quoted JSON string, as in game-of-life-bench
+std::string json_string(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// The empty cell closest to the middle of the map
+Vector2 spawn_point(const map_t &map)
+{
+    float best = -1;
+    Vector2 spawn = { 0, 0 };
+    for (int x = 0; x < map.width; ++x) {
+        for (int y = 0; y < map.height; ++y) {
+            if (map.at(x, y) != CELL_EMPTY)
+                continue;
+            float dx = x - map.width / 2.0f, dy = y - map.height / 2.0f;
+            if (best < 0 || dx * dx + dy * dy < best) {
+                best = dx * dx + dy * dy;
+                spawn = { (x + 0.5f) * map.cell_size, (y + 0.5f) * map.cell_size };
+            }
+        }
+    }
+    return spawn;
+}
+
+// Half cell sized sprites at random spots of random empty cells, with
+// the map's own textures. Seeded, so every run sees the same scene. A
+// streamed map's cells are read from its file, since most of its chunks
+// aren't loaded.
+void scatter_sprites(map_t *map, const map_stream_t *stream, int count)
+{
+    std::vector<Vector2> cells;
+    for (int x = 0; x < map->width; ++x)
+        for (int y = 0; y < map->height; ++y) {
+            uint16_t cell = stream
+                ? stream->view.cells[size_t(y) * map->width + x]
+                : map->at(x, y);
+            if (cell == CELL_EMPTY)
+                cells.push_back({ float(x), float(y) });
+        }
+    std::vector<int> textures;
+    for (auto &[id, path] : map->texture_paths)
+        textures.push_back(id);
+    if (cells.empty() || textures.empty())
+        return;
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> offset(0.25f, 0.75f);
+    for (int i = 0; i < count; ++i) {
+        Vector2 cell = cells[random() % cells.size()];
+        sprite_t sprite;
+        sprite.pos = { (cell.x + offset(random)) * map->cell_size,
+                       (cell.y + offset(random)) * map->cell_size };
+        sprite.texture = textures[random() % textures.size()];
+        sprite.size = map->cell_size / 2.0f;
+        map->sprites.sprites.push_back(sprite);
+    }
+    index_sprites(&map->sprites, map->width, map->height, map->cell_size);
+}
+
+int main(int argc, char **argv)
+{
+    options_t options = {
+        CAST_SINGLE, GRID_ROWS, 600, 0, 720, 720, "../raycasting/test.map", "", 0, 0
+    };
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(arg, "--cast") && has_value) {
+            const char *cast = argv[++i];
+            if (!strcmp(cast, "single"))
+                options.cast = CAST_SINGLE;
+            else if (!strcmp(cast, "packet"))
+                options.cast = CAST_PACKET;
+            else
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--layout") && has_value) {
+            const char *layout = argv[++i];
+            if (!strcmp(layout, "rows"))
+                options.layout = GRID_ROWS;
+            else if (!strcmp(layout, "tiles"))
+                options.layout = GRID_TILES;
+            else
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--frames") && has_value) {
+            options.frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (!strcmp(arg, "--threads") && has_value) {
+            options.threads = std::max(std::atoi(argv[++i]), 0);
+        } else if (!strcmp(arg, "--size") && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width,
+                            &options.height) != 2 ||
+                options.width <= 0 || options.height <= 0)
+                return usage(argv[0]), 1;
+        } else if (!strcmp(arg, "--stream") && has_value) {
+            options.stream_mb = std::max(std::atoi(argv[++i]), 0);
+        } else if (!strcmp(arg, "--sprites") && has_value) {
+            options.sprites = std::max(std::atoi(argv[++i]), 0);
+        } else if (!strcmp(arg, "--save") && has_value) {
+            options.save = argv[++i];
+        } else if (arg[0] == '-') {
+            return usage(argv[0]), 1;
+        } else {
+            options.map = arg;
+        }
+    }
+
+    SetTraceLogLevel(LOG_WARNING);
+    map_t map;
+    map_stream_t stream;
+    bool streamed = options.stream_mb > 0;
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = streamed
+        ? open_map_stream(options.map, size_t(options.stream_mb) << 20, &stream, &map)
+        : load_map(options.map, &map);
+    if (!loaded) {
+        std::fprintf(stderr, "failed to load %s\n", options.map.c_str());
+        return 1;
+    }
+    load_textures(&map);
+    if (streamed) {
+        // Only the chunks around the middle, where the player spawns
+        Vector2 middle = { map.width * map.cell_size / 2.0f,
+                           map.height * map.cell_size / 2.0f };
+        stream_chunks(&stream, &map, middle, int(2 * MAX_RAY_CELLS));
+    }
+    double load_seconds = seconds_since(start);
+    if (!streamed && options.layout != map.layout)
+        set_grid_layout(&map, options.layout);
+    if (streamed && !options.save.empty()) {
+        std::fprintf(stderr, "a streamed map can't be saved\n");
+        return 1;
+    }
+    if (!options.save.empty() && !save_binary_map(options.save, map)) {
+        std::fprintf(stderr, "failed to save %s\n", options.save.c_str());
+        return 1;
+    }
+
+    scatter_sprites(&map, streamed ? &stream : nullptr, options.sprites);
+
+    // The player turns a full circle in the middle of the map
+    player_t player = { spawn_point(map), 0, 100, 60 };
+    framebuffer_t framebuffer(options.width, options.height);
+    std::vector<ray_hits_t> hits;
+
+    // Rays alone, cast the same way the renderer does
+    double cast_seconds = 0;
+    long long rays = (long long)options.frames * options.width;
+    // Sum of the cells where rays stopped, so the casts can't be optimised
+    // away
+    long long checksum = 0;
+    long long ray_hits = 0;
+    float half_plane = tanf(player.fov / 2 * DEG2RAD);
+    // Padded to whole packets
+    int padded = (options.width + PACKET_SIZE - 1) / PACKET_SIZE * PACKET_SIZE;
+    std::vector<Vector2> dirs(padded, { 1, 0 });
+    hits.resize(padded);
+    for (int frame = 0; frame < options.frames; ++frame) {
+        player.rotation = 2 * PI * frame / options.frames;
+        for (int x = 0; x < options.width; ++x) {
+            float plane_x = (2 * (x + 0.5f) / options.width - 1) * half_plane;
+            dirs[x] = { cosf(player.rotation) - sinf(player.rotation) * plane_x,
+                        sinf(player.rotation) + cosf(player.rotation) * plane_x };
+        }
+        start = std::chrono::steady_clock::now();
+        if (options.cast == CAST_PACKET) {
+            for (int x = 0; x < options.width; x += PACKET_SIZE)
+                cast_packet(map, player.pos, &dirs[x], &hits[x]);
+        } else {
+            for (int x = 0; x < options.width; ++x)
+                hits[x] = cast_ray(map, player.pos, dirs[x]);
+        }
+        cast_seconds += seconds_since(start);
+        for (int x = 0; x < options.width; ++x) {
+            const hit_t &hit = hits[x].last();
+            checksum += hit.cell_pos.x * map.height + hit.cell_pos.y;
+            ray_hits += hits[x].count;
+        }
+    }
+
+    // Whole frames. Casting alone above stays on one thread, so comparing
+    // runs with different thread counts shows how rendering scales.
+    thread_pool_t pool(std::max(options.threads, 1));
+    thread_pool_t *render_pool = options.threads > 0 ? &pool : nullptr;
+    double render_seconds = 0;
+    long long visible_sprites = 0;
+    for (int frame = 0; frame < options.frames; ++frame) {
+        player.rotation = 2 * PI * frame / options.frames;
+        start = std::chrono::steady_clock::now();
+        render_view(map, player, options.cast, render_pool, &framebuffer,
+                    &hits);
+        render_seconds += seconds_since(start);
+        visible_sprites += framebuffer.sprites.size();
+    }
+
+    std::printf("{\n");
+    std::printf("  \"map\": %s,\n", json_string(options.map).c_str());
+    std::printf("  \"map_size\": \"%dx%d\",\n", map.width, map.height);
+    std::printf("  \"view_size\": \"%dx%d\",\n", options.width, options.height);
+    std::printf("  \"cast\": \"%s\",\n",
+                options.cast == CAST_PACKET ? "packet" : "single");
+    std::printf("  \"layout\": \"%s\",\n", streamed ? "chunks"
+                : options.layout == GRID_TILES ? "tiles" : "rows");
+    if (streamed)
+        std::printf("  \"resident_chunks\": %zu,\n", stream.chunks.size());
+    std::printf("  \"sprites\": %zu,\n", map.sprites.sprites.size());
+    std::printf("  \"visible_sprites\": %.1f,\n",
+                double(visible_sprites) / options.frames);
+    std::printf("  \"frames\": %d,\n", options.frames);
+    std::printf("  \"threads\": %d,\n", options.threads);
+    std::printf("  \"load_ms\": %.3f,\n", load_seconds * 1000);
+    std::printf("  \"rays_per_second\": %.1f,\n", rays / cast_seconds);
+    std::printf("  \"hit_checksum\": %lld,\n", checksum);
+    std::printf("  \"hits_per_ray\": %.3f,\n", double(ray_hits) / rays);
+    std::printf("  \"frame_ms\": %.3f,\n", render_seconds * 1000 / options.frames);
+    std::printf("  \"frames_per_second\": %.1f\n", options.frames / render_seconds);
+    std::printf("}\n");
+
+    if (streamed)
+        close_map_stream(&stream, &map);
+    unload_map(&map);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include "map_format.hpp"
 namespace fs = std::filesystem;
 
 #define SCALE_DELTA 0.3
@@ -83,6 +84,30 @@ struct context_t
 
         return data;
     }
+
+    // Same map in the binary format, cells row by row in the raycaster's
+    // x, y which are the board's row, column
+    bool
+    save_binary(const std::string &filename)
+    {
+        std::vector<std::pair<int, std::string>> used;
+        std::vector<bool> seen(this->images_loaded, false);
+        std::vector<uint16_t> cells(this->board_size.rows * this->board_size.cols);
+        for (int i = 0; i < this->board_size.rows; ++i)
+            for (int j = 0; j < this->board_size.cols; ++j)
+            {
+                int cell = this->board[i][j];
+                cells[j * this->board_size.rows + i] = cell == -1 ? MAP_EMPTY : cell;
+                if (cell != -1 && !seen[cell])
+                {
+                    seen[cell] = true;
+                    used.push_back({ cell, this->filenames[cell] });
+                }
+            }
+        // The editor only places plain walls
+        return write_binary_map(filename, this->board_size.rows,
+                                this->board_size.cols, used, {}, {}, cells);
+    }
 };
 
 int main()
@@ -126,6 +151,7 @@ int main()
 
     char filename_text[32] = "./test.map";
     bool filename_edit = false;
+    bool export_failed = false;
 
     while (!WindowShouldClose())
     {
@@ -254,10 +280,23 @@ int main()
 
                 if (GuiButton(Rectangle { 415, 10, 125, 30 }, "Export Map"))
                 {
-                    std::ofstream map_file;
-                    map_file.open (filename_text);
-                    map_file << context.get_map_data();
-                    map_file.close();
+                    // Maps named *.rmap are exported in the binary format
+                    if (fs::path(filename_text).extension() == ".rmap")
+                    {
+                        export_failed = !context.save_binary(filename_text);
+                    }
+                    else
+                    {
+                        std::ofstream map_file;
+                        map_file.open (filename_text);
+                        map_file << context.get_map_data();
+                        map_file.close();
+                        export_failed = map_file.fail();
+                    }
+                }
+                if (export_failed)
+                {
+                    DrawText("Export failed", 280, 45, 10, RED);
                 }
 
                 std::string menu = "";
@@ -0,0 +1,289 @@
+#include "caster.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Amanatides-Woo traversal: the ray visits every cell it crosses, in
+// order, stepping to whichever grid line, vertical or horizontal, is
+// closer along the ray. Distances below are measured in cells, per unit
+// of the ray's length.
+
+// Record a hit distance cells along the ray
+static void
+add_hit(const map_t &map, Vector2 pos, Vector2 ray, float distance,
+        int cell_x, int cell_y, int cell, bool horizontal, float u,
+        ray_hits_t *hits)
+{
+    hit_t &hit = hits->hits[hits->count++];
+    hit.dist = distance * map.cell_size;
+    hit.pos = { pos.x + ray.x * hit.dist, pos.y + ray.y * hit.dist };
+    hit.cell_pos = { cell_x, cell_y };
+    hit.cell = cell;
+    hit.is_horizontal = horizontal;
+    hit.u = u;
+}
+
+// A ray from outside the map sees nothing
+static ray_hits_t
+miss(const map_t &map, Vector2 pos, Vector2 ray, int cell_x, int cell_y)
+{
+    ray_hits_t hits;
+    hits.count = 0;
+    add_hit(map, pos, ray, MAX_RAY_CELLS, cell_x, cell_y, -1, false, 0, &hits);
+    return hits;
+}
+
+// The map's border is solid, so a ray stops at the edge without a bounds
+// check as long as it starts inside
+static int
+hit_cell(uint16_t cell)
+{
+    return cell == CELL_BORDER ? -1 : cell;
+}
+
+// The ray from start, in cells, has moved into a cell that isn't empty at
+// entry cells along it, crossing an x grid line if x_side, and leaves it
+// at exit. Records what it hits in there, if anything, and returns
+// whether the ray stops. Full walls are hit where the ray enters, the
+// rest needs a closer look at the cell.
+static bool
+enter_cell(const map_t &map, Vector2 pos, Vector2 start, Vector2 ray,
+           int cell_x, int cell_y, uint16_t cell, float entry, float exit,
+           bool x_side, ray_hits_t *hits)
+{
+    const cell_type_t &type = map.cell_types[cell];
+    float distance = entry;
+    bool horizontal = !x_side;
+    // Position in the cell, from 0 to 1 on each axis, at distance
+    auto local = [&](float t) {
+        return Vector2{ start.x + ray.x * t - cell_x, start.y + ray.y * t - cell_y };
+    };
+    float u = 0;
+    switch (type.kind)
+    {
+    case CELL_SOLID:
+        u = x_side ? start.y + ray.y * entry - cell_y : start.x + ray.x * entry - cell_x;
+        break;
+    case CELL_DOOR_X:
+    case CELL_DOOR_Y:
+    {
+        // The panel is at the middle of the cell and slides towards 0
+        // along itself as it opens, so the part of it left is [open, 1)
+        bool door_x = type.kind == CELL_DOOR_X;
+        float across = door_x ? ray.x : ray.y;
+        if (across == 0)
+            return false;
+        float t = door_x
+            ? (cell_x + 0.5f - start.x) / across
+            : (cell_y + 0.5f - start.y) / across;
+        if (t < entry || t >= exit)
+            return false;
+        float along = door_x ? local(t).y : local(t).x;
+        float open = map.door_open(cell_x, cell_y);
+        if (along < open)
+            return false;
+        distance = t;
+        horizontal = !door_x;
+        u = along - open;
+        break;
+    }
+    case CELL_DIAGONAL:
+    case CELL_ANTIDIAGONAL:
+    {
+        // Where the ray crosses y = x, or y = 1 - x, in the cell
+        Vector2 corner = local(0);
+        float t = type.kind == CELL_DIAGONAL
+            ? (corner.y - corner.x) / (ray.x - ray.y)
+            : (1 - corner.x - corner.y) / (ray.x + ray.y);
+        if (!(t >= entry && t < exit))
+            return false;
+        distance = t;
+        horizontal = false;
+        u = local(t).x;
+        break;
+    }
+    }
+
+    add_hit(map, pos, ray, distance, cell_x, cell_y, hit_cell(cell), horizontal,
+            std::clamp(u, 0.0f, 1.0f), hits);
+    return type.full || hits->count == MAX_HITS;
+}
+
+ray_hits_t cast_ray(const map_t &map, Vector2 pos, Vector2 ray)
+{
+    Vector2 start = pos / map.cell_size;
+    int cell_x = int(std::floor(start.x));
+    int cell_y = int(std::floor(start.y));
+    if (!correct_cell(map, cell_x, cell_y))
+        return miss(map, pos, ray, cell_x, cell_y);
+
+    // Distance between two grid lines of each kind, and to the first ones
+    int step_x = ray.x < 0 ? -1 : 1;
+    int step_y = ray.y < 0 ? -1 : 1;
+    float delta_x = ray.x != 0 ? std::abs(1 / ray.x) : INFINITY;
+    float delta_y = ray.y != 0 ? std::abs(1 / ray.y) : INFINITY;
+    float side_x = ray.x != 0
+        ? (ray.x < 0 ? start.x - cell_x : cell_x + 1 - start.x) * delta_x
+        : INFINITY;
+    float side_y = ray.y != 0
+        ? (ray.y < 0 ? start.y - cell_y : cell_y + 1 - start.y) * delta_y
+        : INFINITY;
+
+    ray_hits_t hits;
+    hits.count = 0;
+    // Doors and thin walls can share the cell the ray starts in
+    uint16_t first = map.at(cell_x, cell_y);
+    if (first != CELL_EMPTY && map.cell_types[first].kind != CELL_SOLID &&
+        enter_cell(map, pos, start, ray, cell_x, cell_y, first, 0,
+                   std::min(side_x, side_y), false, &hits))
+        return hits;
+
+    while (true) {
+        float distance;
+        bool x_side = side_x < side_y;
+        if (x_side) {
+            distance = side_x;
+            side_x += delta_x;
+            cell_x += step_x;
+        }
+        else {
+            distance = side_y;
+            side_y += delta_y;
+            cell_y += step_y;
+        }
+
+        if (distance > MAX_RAY_CELLS) {
+            add_hit(map, pos, ray, MAX_RAY_CELLS, cell_x, cell_y, -1, !x_side, 0, &hits);
+            break;
+        }
+        uint16_t cell = map.at(cell_x, cell_y);
+        if (cell == CELL_EMPTY)
+            continue;
+        if (map.cell_types[cell].full) {
+            float u = x_side ? start.y + ray.y * distance - cell_y : start.x + ray.x * distance - cell_x;
+            add_hit(map, pos, ray, distance, cell_x, cell_y, hit_cell(cell), !x_side, u, &hits);
+            break;
+        }
+        if (enter_cell(map, pos, start, ray, cell_x, cell_y, cell, distance,
+                       std::min(side_x, side_y), x_side, &hits))
+            break;
+    }
+    return hits;
+}
+
+// A lane that moved into a cell that isn't empty or went too far. Returns
+// whether it stops, like enter_cell().
+static bool
+stop_lane(const map_t &map, Vector2 pos, Vector2 start, Vector2 ray,
+          int cell_x, int cell_y, uint16_t cell, float distance, float exit,
+          bool x_side, ray_hits_t *hits)
+{
+    if (distance > MAX_RAY_CELLS) {
+        add_hit(map, pos, ray, MAX_RAY_CELLS, cell_x, cell_y, -1, !x_side, 0, hits);
+        return true;
+    }
+    return enter_cell(map, pos, start, ray, cell_x, cell_y, cell, distance,
+                      exit, x_side, hits);
+}
+
+void cast_packet(const map_t &map, Vector2 pos, const Vector2 *rays, ray_hits_t *hits)
+{
+    // Rays parallel to an axis never cross grid lines of the other kind.
+    // A huge finite distance stands in for infinity, so that multiplying
+    // it by a 0/1 mask stays 0.
+    const float NEVER = 1e30f;
+    const int N = PACKET_SIZE;
+    float ray_x[N], ray_y[N];
+    float delta_x[N], delta_y[N], side_x[N], side_y[N], distance[N];
+    int step_x[N], step_y[N], cell_x[N], cell_y[N], x_side[N];
+    // 1 while a lane hasn't stopped
+    int active[N];
+
+    Vector2 start = pos / map.cell_size;
+    int start_x = int(std::floor(start.x));
+    int start_y = int(std::floor(start.y));
+    if (!correct_cell(map, start_x, start_y)) {
+        for (int l = 0; l < N; ++l)
+            hits[l] = miss(map, pos, rays[l], start_x, start_y);
+        return;
+    }
+
+    // Starting in the cell of a door or thin wall is rare, cast_ray()
+    // deals with it
+    uint16_t first = map.at(start_x, start_y);
+    if (first != CELL_EMPTY && map.cell_types[first].kind != CELL_SOLID) {
+        for (int l = 0; l < N; ++l)
+            hits[l] = cast_ray(map, pos, rays[l]);
+        return;
+    }
+
+    for (int l = 0; l < N; ++l) {
+        ray_x[l] = rays[l].x;
+        ray_y[l] = rays[l].y;
+        cell_x[l] = start_x;
+        cell_y[l] = start_y;
+        step_x[l] = ray_x[l] < 0 ? -1 : 1;
+        step_y[l] = ray_y[l] < 0 ? -1 : 1;
+        delta_x[l] = ray_x[l] != 0 ? std::min(std::abs(1 / ray_x[l]), NEVER) : NEVER;
+        delta_y[l] = ray_y[l] != 0 ? std::min(std::abs(1 / ray_y[l]), NEVER) : NEVER;
+        side_x[l] = (ray_x[l] < 0 ? start.x - cell_x[l] : cell_x[l] + 1 - start.x) * delta_x[l];
+        side_y[l] = (ray_y[l] < 0 ? start.y - cell_y[l] : cell_y[l] + 1 - start.y) * delta_y[l];
+        active[l] = 1;
+        hits[l].count = 0;
+    }
+
+    // Step the packet while most lanes are still going, then finish the
+    // stragglers one by one instead of dragging idle lanes along
+    int remaining = N;
+    while (remaining * 2 > N) {
+        // All lanes step, without branches so the loop vectorises. Lanes
+        // that are done were already written out and stay on their wall,
+        // which keeps them inside the grid.
+        for (int l = 0; l < N; ++l) {
+            int x_step = int(side_x[l] < side_y[l]) & active[l];
+            int y_step = int(side_x[l] >= side_y[l]) & active[l];
+            x_side[l] = side_x[l] < side_y[l];
+            distance[l] = std::min(side_x[l], side_y[l]);
+            side_x[l] += delta_x[l] * float(x_step);
+            side_y[l] += delta_y[l] * float(y_step);
+            cell_x[l] += step_x[l] * x_step;
+            cell_y[l] += step_y[l] * y_step;
+        }
+
+        // Look up the cells the lanes moved into, with a branch only for
+        // the rare lane that has just hit
+        for (int l = 0; l < N; ++l) {
+            uint16_t cell = map.at(cell_x[l], cell_y[l]);
+            bool too_far = distance[l] > MAX_RAY_CELLS;
+            if (active[l] && (cell != CELL_EMPTY || too_far) &&
+                stop_lane(map, pos, start, rays[l], cell_x[l], cell_y[l], cell,
+                          distance[l], std::min(side_x[l], side_y[l]),
+                          x_side[l], &hits[l])) {
+                active[l] = 0;
+                remaining--;
+            }
+        }
+    }
+
+    for (int l = 0; l < N; ++l) {
+        if (!active[l])
+            continue;
+        while (true) {
+            x_side[l] = side_x[l] < side_y[l];
+            distance[l] = std::min(side_x[l], side_y[l]);
+            if (x_side[l]) {
+                side_x[l] += delta_x[l];
+                cell_x[l] += step_x[l];
+            }
+            else {
+                side_y[l] += delta_y[l];
+                cell_y[l] += step_y[l];
+            }
+            uint16_t cell = map.at(cell_x[l], cell_y[l]);
+            if ((distance[l] > MAX_RAY_CELLS || cell != CELL_EMPTY) &&
+                stop_lane(map, pos, start, rays[l], cell_x[l], cell_y[l], cell,
+                          distance[l], std::min(side_x[l], side_y[l]),
+                          x_side[l], &hits[l]))
+                break;
+        }
+    }
+}
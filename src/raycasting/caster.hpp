@@ -0,0 +1,57 @@
+#ifndef CASTER_HPP
+#define CASTER_HPP
+
+#include "map.hpp"
+
+// Rays give up this many cells away, measured in ray lengths
+const float MAX_RAY_CELLS = 64;
+
+// Rays traced together by cast_packet()
+const int PACKET_SIZE = 8;
+
+// Walls a ray records, the last of them being where it stopped
+const int MAX_HITS = 4;
+
+enum cast_mode_t {
+    // One ray at a time
+    CAST_SINGLE,
+    // PACKET_SIZE adjacent rays at a time
+    CAST_PACKET,
+};
+
+struct hit_t {
+    Vector2 pos;
+    struct { int x, y; } cell_pos;
+    // Texture id of the wall, -1 if the ray left the map or gave up
+    int cell;
+    bool is_horizontal;
+    // How far along the ray the hit is, times the ray's length. For a ray
+    // through the camera plane this is the distance from the plane, which
+    // needs no fisheye correction.
+    float dist;
+    // Where along the wall the hit is, from 0 to 1, the texture column
+    float u;
+};
+
+// The walls a ray sees, near to far. Rays go on past walls that don't
+// hide everything behind them: short walls, doors and thin walls. The last
+// hit is where the ray stopped, at a full wall, the edge of the map or
+// MAX_RAY_CELLS, or at whatever it met once the list was full.
+struct ray_hits_t {
+    int count;
+    hit_t hits[MAX_HITS];
+
+    const hit_t &last() const
+    {
+        return hits[count - 1];
+    }
+};
+
+// Walls hit by a ray from pos. The ray needn't be normalised.
+ray_hits_t cast_ray(const map_t &map, Vector2 pos, Vector2 ray);
+// Same as cast_ray() for PACKET_SIZE rays. Adjacent rays cross
+// mostly the same cells, so they are stepped together, one lane per ray,
+// until every lane has stopped.
+void cast_packet(const map_t &map, Vector2 pos, const Vector2 *rays, ray_hits_t *hits);
+
+#endif // CASTER_HPP
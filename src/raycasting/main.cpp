@@ -3,131 +3,30 @@
 #include <algorithm>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <map>
+#include <unordered_map>
 #include <iostream>
+#include "renderer.hpp"
+#include "stream.hpp"
 
 const int screenWidth = 720;
 const int screenHeight = 720;
 
-int board_w = 8;
-int board_h = 8;
+// Fraction of a door opened or closed per second
+const float DOOR_SPEED = 1.5f;
+// Doors let the player through once open this far
+const float DOOR_PASSABLE = 0.9f;
 
-int cell_size = screenWidth / board_w;
+map_t map;
+// Doors on the move, by the same index as map_t::doors, 1 when opening
+// and -1 when closing
+std::unordered_map<size_t, int> moving_doors;
 
-std::vector<std::vector<int>> board;
-std::map<int, Image> images;
-
-Image floor_texture = LoadImage("./resources/FLOOR_1A.png");
-Image ceiling_texture = LoadImage("./resources/LIGHT_1C.png");
-
-struct player_t {
-    Vector2 pos;
-    float rotation;
-    float speed;
-    float fov;
-    int rays_count;
-};
-
-struct hit_t {
-    Vector2 pos;
-    struct { int x, y; } cell_pos;
-    bool is_horizontal;
-    float angle;
-};
-
-bool correct_cell(int x, int y)
-{
-    return (x >= 0 && x < board_w) && (y >= 0 && y < board_h);
-}
-
-float
-fix_angle(float angle)
+bool
+is_door(int x, int y)
 {
-    while (angle > PI)  angle -= 2 * PI;
-    while (angle < -PI) angle += 2 * PI;
-    return angle;
-}
-
-hit_t cast_ray(Vector2 pos, float dir)
-{
-    dir = fix_angle(dir);
-
-    int cell_x = pos.x / cell_size;
-    int cell_y = pos.y / cell_size;
-
-    hit_t hit_data_v, hit_data_h;
-
-    // Vertical hit
-    for (int k = 0; ; ++k) {
-        int shift;
-        int k_dir;
-        if (dir > -PI / 2 && dir < PI / 2) {
-            shift = 1;
-            k_dir = 1;
-        }
-        else {
-            shift = 0;
-            k_dir = -1;
-        }
-
-        float dx = (cell_x + shift + k * k_dir) * cell_size - pos.x;
-        float dy = dx * tan(dir);
-        Vector2 d = { dx, dy };
-        Vector2 hit = d + pos;
-
-        int cell_hit_x = int(hit.x / cell_size) + shift - 1;
-        int cell_hit_y = int(hit.y / cell_size);
-
-        hit_data_v.pos = hit;
-        hit_data_v.cell_pos = { cell_hit_x, cell_hit_y };
-        hit_data_v.is_horizontal = false;
-        hit_data_v.angle = dir;
-
-        if (!correct_cell(cell_hit_x, cell_hit_y))
-            break;
-        if (board[cell_hit_x][cell_hit_y] != -1)
-            break;
-    }
-
-    // Horizontal hit
-    for (int k = 0; ; ++k) {
-        int shift;
-        int k_dir;
-        if (dir > -PI && dir < 0) {
-            shift = 0;
-            k_dir = -1;
-        }
-        else {
-            shift = 1;
-            k_dir = 1;
-        }
-
-        float dy = (cell_y + shift + k * k_dir) * cell_size - pos.y;
-        float dx = dy / tan(dir);
-        Vector2 d = { dx, dy };
-        Vector2 hit = d + pos;
-
-        int cell_hit_x = int(hit.x / cell_size);
-        int cell_hit_y = int(hit.y / cell_size) + shift - 1;
-
-        hit_data_h.pos = hit;
-        hit_data_h.cell_pos = { cell_hit_x, cell_hit_y };
-        hit_data_h.is_horizontal = true;
-        hit_data_h.angle = dir;
-
-        if (!correct_cell(cell_hit_x, cell_hit_y))
-            break;
-        if (board[cell_hit_x][cell_hit_y] != -1)
-            break;
-    }
-
-    if (Vector2Length(hit_data_h.pos - pos) < Vector2Length(hit_data_v.pos - pos)) {
-        return hit_data_h;
-    }
-    else {
-        return hit_data_v;
-    }
+    // Empty cells count as solid in cell_types
+    cell_kind_t kind = map.cell_types[map.at(x, y)].kind;
+    return kind == CELL_DOOR_X || kind == CELL_DOOR_Y;
 }
 
 bool
@@ -136,65 +35,101 @@ check_collision(Vector2 position, float radius)
     for (float angle = -PI; angle < PI; angle += PI / 4)
     {
         Vector2 check = position + Vector2Rotate({ radius, 0 }, angle);
-        int cell_x = check.x / cell_size;
-        int cell_y = check.y / cell_size;
-        if (board[cell_x][cell_y] != -1)
+        int cell_x = check.x / map.cell_size;
+        int cell_y = check.y / map.cell_size;
+        if (!correct_cell(map, cell_x, cell_y))
+            return true;
+        if (is_door(cell_x, cell_y) && map.door_open(cell_x, cell_y) >= DOOR_PASSABLE)
+            continue;
+        if (map.at(cell_x, cell_y) != CELL_EMPTY)
             return true;
     }
     return false;
 }
 
+// Open or close the door in the cell in front of the player, if any
 void
-parse_map(std::string filename)
+use_door(const player_t &player)
 {
-    int rows, cols;
-    int texture_count;
-    std::ifstream map_file(filename);
-    map_file >> rows >> cols >> texture_count;
-
-    board_w = rows;
-    board_h = cols;
-
-    if (rows > cols)
-        cell_size = screenHeight / rows;
+    Vector2 front = player.pos + Vector2Rotate({ float(map.cell_size), 0 }, player.rotation);
+    int cell_x = front.x / map.cell_size;
+    int cell_y = front.y / map.cell_size;
+    if (!correct_cell(map, cell_x, cell_y) || !is_door(cell_x, cell_y))
+        return;
+    size_t index = size_t(cell_y) * map.width + cell_x;
+    auto it = moving_doors.find(index);
+    if (it != moving_doors.end())
+        it->second = -it->second;
     else
-        cell_size = screenWidth / cols;
-    
-    for (int i = 0; i < texture_count; ++i)
-    {
-        int texture_id;
-        std::string texture_path;
-        map_file >> texture_id >> texture_path;
-        images[texture_id] = LoadImage(texture_path);
-    }
+        moving_doors[index] = map.door_open(cell_x, cell_y) > 0 ? -1 : 1;
+}
 
-    board = std::vector(rows, std::vector(cols, -1));
-    for (int i = 0; i < rows; ++i)
+void
+move_doors(float dt)
+{
+    for (auto it = moving_doors.begin(); it != moving_doors.end();)
     {
-        for (int j = 0; j < cols; ++j)
-        {
-            map_file >> board[i][j];
-        }
+        float &open = map.doors[it->first];
+        open = std::clamp(open + it->second * DOOR_SPEED * dt, 0.0f, 1.0f);
+        if (open == 0 || open == 1)
+            it = moving_doors.erase(it);
+        else
+            ++it;
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
     InitWindow(screenWidth * 2, screenHeight, "GDSC: Creative Coding");
     SetTargetFPS(60);
 
-    std::string map_filename = "./test.map";
-    parse_map(map_filename);
+    // Text maps are loaded whole. Binary ones, saved by the map editor,
+    // can be far bigger and are streamed in chunks around the player.
+    std::string map_filename = argc > 1 ? argv[1] : "./test.map";
+    map_stream_t stream;
+    bool streamed = is_binary_map(map_filename);
+    bool loaded = streamed
+        ? open_map_stream(map_filename, DEFAULT_STREAM_BYTES, &stream, &map)
+        : load_map(map_filename, &map);
+    if (!loaded)
+    {
+        std::cerr << "failed to load " << map_filename << std::endl;
+        CloseWindow();
+        return 1;
+    }
+
+    // Walls show placeholders until their textures are decoded
+    texture_loader_t loader;
+    request_textures(map, &loader);
 
     player_t player;
-    player.pos = { screenWidth / 2, screenHeight / 2 };
+    player.pos = {
+        (map.width / 2 + 0.5f) * map.cell_size,
+        (map.height / 2 + 0.5f) * map.cell_size
+    };
     player.speed = 100;
     player.rotation = 0;
     player.fov = 60;
-    player.rays_count = 240;
-    float delta_angle = player.fov / player.rays_count;
+
+    // The 3D view is rendered on the CPU, one ray per column, and uploaded
+    // as a single texture every frame
+    framebuffer_t framebuffer(screenWidth, screenHeight);
+    Image view_image = GenImageColor(screenWidth, screenHeight, BLACK);
+    Texture2D view_texture = LoadTextureFromImage(view_image);
+    UnloadImage(view_image);
+    std::vector<ray_hits_t> hits;
+    // Columns are rendered in parallel, uploading and the 2D map stay on
+    // the main thread
+    thread_pool_t pool(std::max(int(std::thread::hardware_concurrency()), 1));
+
+    // The 2D map scrolls with the player
+    Camera2D minimap = {};
+    minimap.offset = { screenWidth / 2, screenHeight / 2 };
+    minimap.zoom = 1;
 
     bool mouse_2d = false;
+    // C switches between casting rays one by one and in packets
+    cast_mode_t cast_mode = CAST_SINGLE;
 
     while (!WindowShouldClose())
     {
@@ -212,10 +147,7 @@ int main()
             if (IsKeyDown(KEY_D))
                 move.x += player.speed * dt;
 
-            Vector2 mp = {
-                GetMouseX() - player.pos.x,
-                GetMouseY() - player.pos.y
-            };
+            Vector2 mp = GetScreenToWorld2D(GetMousePosition(), minimap) - player.pos;
             player.rotation = Vector2Angle({ 1, 0 }, mp);
         }
         else
@@ -239,123 +171,93 @@ int main()
         if (check_collision(player.pos, 15))
             player.pos -= move;
 
+        // Rays give up MAX_RAY_CELLS ray lengths away, and a ray through
+        // the edge of the view is 1 / cos(fov / 2) times as long as the one
+        // straight ahead. Twice the distance covers any fov up to 120
+        // degrees.
+        if (streamed)
+            stream_chunks(&stream, &map, player.pos, int(2 * MAX_RAY_CELLS));
+        install_textures(&map, &loader);
+        minimap.target = player.pos;
+
+        // E opens and closes doors
+        if (IsKeyPressed(KEY_E))
+            use_door(player);
+        move_doors(dt);
+
+        if (IsKeyPressed(KEY_C))
+            cast_mode = cast_mode == CAST_PACKET ? CAST_SINGLE : CAST_PACKET;
+        render_view(map, player, cast_mode, &pool, &framebuffer, &hits);
+        UpdateTexture(view_texture, framebuffer.pixels.data());
 
         BeginDrawing();
         {
             ClearBackground(BLACK);
-            
-            DrawRectangle(screenWidth, screenHeight / 2, screenWidth, screenHeight / 2, BLACK);
 
-            for (int row = 0; row < board_h; ++row) {
-                for (int col = 0; col < board_w; ++col) {
-                    if (board[col][row] != -1) {
-                        DrawRectangle(col * cell_size, row * cell_size,
-                            cell_size, cell_size, BLACK);
+            BeginScissorMode(0, 0, screenWidth, screenHeight);
+            BeginMode2D(minimap);
+
+            // Only the cells in view
+            Vector2 corner = GetScreenToWorld2D({ 0, 0 }, minimap);
+            int first_col = std::max(int(corner.x / map.cell_size), 0);
+            int first_row = std::max(int(corner.y / map.cell_size), 0);
+            int last_col = std::min(int((corner.x + screenWidth) / map.cell_size), map.width - 1);
+            int last_row = std::min(int((corner.y + screenHeight) / map.cell_size), map.height - 1);
+            for (int row = first_row; row <= last_row; ++row) {
+                for (int col = first_col; col <= last_col; ++col) {
+                    if (map.at(col, row) != CELL_EMPTY) {
+                        DrawRectangle(col * map.cell_size, row * map.cell_size,
+                            map.cell_size, map.cell_size, BLACK);
                     }
                     else
                     {
-                        DrawRectangle(col * cell_size, row * cell_size,
-                            cell_size, cell_size, WHITE);
+                        DrawRectangle(col * map.cell_size, row * map.cell_size,
+                            map.cell_size, map.cell_size, WHITE);
                     }
                 }
             }
 
-            for (int x = cell_size; x < screenWidth; x += cell_size) {
-                DrawLine(x, 0, x, screenHeight, GRAY);
+            for (int col = first_col; col <= last_col + 1; ++col) {
+                int x = col * map.cell_size;
+                DrawLine(x, first_row * map.cell_size, x, (last_row + 1) * map.cell_size, GRAY);
             }
-            for (int y = cell_size; y < screenHeight; y += cell_size) {
-                DrawLine(0, y, screenWidth, y, GRAY);
-            }
-
-            DrawCircleV(player.pos, 14, RED);
-
-            DrawLineEx(player.pos, player.pos + Vector2Rotate({ 1,0 }, player.rotation) * 25, 5, BLUE);
-
-            std::vector<hit_t> hits;
-            for (float angle = -player.fov / 2; angle < player.fov / 2; angle += delta_angle) {
-                hit_t hit = cast_ray(player.pos, player.rotation + angle * DEG2RAD);
-                DrawLineEx(player.pos, hit.pos, 2, BLUE);
-                hits.push_back(hit);
+            for (int row = first_row; row <= last_row + 1; ++row) {
+                int y = row * map.cell_size;
+                DrawLine(first_col * map.cell_size, y, (last_col + 1) * map.cell_size, y, GRAY);
             }
 
-            float rect_x = 0;
-            for (hit_t& hit : hits)
-            {
-                Vector2 hit_delta = hit.pos - player.pos;
-                float dist = hit_delta.x * cos(player.rotation) +
-                    hit_delta.y * sin(player.rotation);
-
-                int shading = int(128.0 * dist / 900);
-
-                float rect_h = (cell_size * screenHeight) / dist;
-                float rect_w = (screenWidth / player.fov) * delta_angle;
-                float rect_y = (screenHeight - rect_h) / 2;
-
-                int image_idx = board[hit.cell_pos.x][hit.cell_pos.y];
-                Image cell_image = images[image_idx];
-
-                Vector2 pos_in_cell = {
-                    hit.pos.x - hit.cell_pos.x * cell_size,
-                    hit.pos.y - hit.cell_pos.y * cell_size,
-                };
-
-                Vector2 column = pos_in_cell / cell_size * cell_image.width;
-                int col = column.y;
-                if (hit.is_horizontal)
-                    col = column.x;
-                
-                for (int i = 0; i < cell_image.height; ++i)
-                {
-                    Color* color_data = (Color*)cell_image.data;
-                    Color pixel = color_data[i * cell_image.width + col];
-                    pixel.r = std::clamp(pixel.r - shading, 0, 255);
-                    pixel.g = std::clamp(pixel.g - shading, 0, 255);
-                    pixel.b = std::clamp(pixel.b - shading, 0, 255);
-
-                    DrawRectangle(
-                        screenWidth + rect_x, rect_y + rect_h / cell_image.height * i,
-                        rect_w + 1, rect_h / cell_image.height + 1, pixel
-                    );
+            // Sprites in the blocks under the cells in view
+            const sprite_set_t &sprites = map.sprites;
+            int last_block_x = std::min(last_col / SPRITE_BLOCK, sprites.width - 1);
+            int last_block_y = std::min(last_row / SPRITE_BLOCK, sprites.height - 1);
+            for (int by = first_row / SPRITE_BLOCK; by <= last_block_y; ++by) {
+                for (int bx = first_col / SPRITE_BLOCK; bx <= last_block_x; ++bx) {
+                    int block = by * sprites.width + bx;
+                    for (int i = sprites.block_start[block]; i < sprites.block_start[block + 1]; ++i) {
+                        const sprite_t &sprite = sprites.sprites[sprites.block_sprites[i]];
+                        DrawCircleV(sprite.pos, sprite.size / 4, DARKGREEN);
+                    }
                 }
+            }
 
-                for (int row = rect_y + rect_h; row < screenHeight; ++row)
-                {
-                    float dy = row - screenHeight / 2;
-                    float raFix = cosf(fix_angle(player.rotation - hit.angle));
-                    int magic = 200;
-                    int tx = player.pos.x / 2 + cosf(hit.angle) * magic * floor_texture.width / dy / raFix;
-                    int ty = player.pos.y / 2 + sinf(hit.angle) * magic * floor_texture.height / dy / raFix;
+            DrawCircleV(player.pos, 14, RED);
 
-                    shading = int(1.0 / float(row) * screenHeight * 28);
+            DrawLineEx(player.pos, player.pos + Vector2Rotate({ 1,0 }, player.rotation) * 25, 5, BLUE);
 
-                    int fw = floor_texture.width;
-                    Color* floor_data = (Color*)floor_texture.data;
-                    Color floor_pixel = floor_data[(ty & (fw - 1)) * fw + (tx & (fw - 1))];
-                    floor_pixel.r = std::clamp(floor_pixel.r - shading, 0, 255);
-                    floor_pixel.g = std::clamp(floor_pixel.g - shading, 0, 255);
-                    floor_pixel.b = std::clamp(floor_pixel.b - shading, 0, 255);
-                    DrawRectangle(
-                        screenWidth + rect_x, row + rect_h / floor_texture.height,
-                        rect_w + 1, rect_h / floor_texture.height + 1, floor_pixel
-                    );
+            for (ray_hits_t& column : hits)
+                DrawLineEx(player.pos, column.last().pos, 2, BLUE);
 
-                    int cw = ceiling_texture.width;
-                    Color* ceiling_data = (Color*)ceiling_texture.data;
-                    Color ceiling_pixel = ceiling_data[(ty & (cw - 1)) * cw + (tx & (cw - 1))];
-                    ceiling_pixel.r = std::clamp(ceiling_pixel.r - shading, 0, 255);
-                    ceiling_pixel.g = std::clamp(ceiling_pixel.g - shading, 0, 255);
-                    ceiling_pixel.b = std::clamp(ceiling_pixel.b - shading, 0, 255);
-                    DrawRectangle(
-                        screenWidth + rect_x, screenHeight - row - rect_h / ceiling_texture.height,
-                        rect_w + 1, rect_h / ceiling_texture.height + 1, ceiling_pixel
-                    );
-                }
+            EndMode2D();
+            EndScissorMode();
 
-                rect_x += rect_w;
-            }
+            DrawTexture(view_texture, screenWidth, 0, WHITE);
         }
         EndDrawing();
     }
+    UnloadTexture(view_texture);
+    if (streamed)
+        close_map_stream(&stream, &map);
+    unload_map(&map);
     CloseWindow();
 
     return 0;
@@ -0,0 +1,308 @@
+#include "map.hpp"
+#include "map_format.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+
+static Image
+load_texture_image(const std::string &path)
+{
+    Image image = LoadImage(path.c_str());
+    if (!image.data)
+        image = GenImageChecked(64, 64, 8, 8, MAGENTA, BLACK);
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    return image;
+}
+
+// Sizes the map, floor and ceiling come later from load_floor_ceiling
+static void
+init_map(const std::string &filename, int width, int height, map_t *map)
+{
+    map->directory = GetDirectoryPath(filename.c_str());
+    map->width = width;
+    map->height = height;
+    map->cell_size = CELL_SIZE;
+    map->textures.clear();
+    map->texture_paths.clear();
+    map->sprites.sprites.clear();
+    map->cell_types.assign(CELL_EMPTY + 1, { CELL_SOLID, 1, true });
+    map->doors.clear();
+}
+
+// Only once the map is known to load, so a failed parse leaks nothing
+static void
+load_floor_ceiling(map_t *map)
+{
+    map->floor_texture = load_texture_image(map->directory + "/resources/FLOOR_1A.png");
+    map->ceiling_texture = load_texture_image(map->directory + "/resources/LIGHT_1C.png");
+}
+
+// Wall textures start out as placeholders
+static void
+add_texture(int id, const std::string &path, map_t *map)
+{
+    map->textures[id] = placeholder_texture();
+    map->texture_paths[id] = path;
+}
+
+bool
+parse_map(const std::string &filename, map_t *map)
+{
+    int rows, cols;
+    int texture_count;
+    std::ifstream map_file(filename);
+    if (!(map_file >> rows >> cols >> texture_count) || rows <= 0 || cols <= 0)
+        return false;
+
+    init_map(filename, rows, cols, map);
+    for (int i = 0; i < texture_count; ++i)
+    {
+        int texture_id;
+        std::string texture_path;
+        map_file >> texture_id >> texture_path;
+        add_texture(texture_id, texture_path, map);
+    }
+
+    init_grid(map, rows, cols, GRID_ROWS);
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            int id;
+            map_file >> id;
+            if (id < 0 || id >= CELL_BORDER)
+                continue;
+            map->set(i, j, id);
+            if (!map->textures.count(id))
+                map->textures[id] = placeholder_texture();
+        }
+    }
+    if (!map_file)
+        return false;
+
+    std::string section;
+    int count;
+    while (map_file >> section >> count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            if (section == "sprites")
+            {
+                sprite_t sprite;
+                if (!(map_file >> sprite.pos.x >> sprite.pos.y >> sprite.texture >> sprite.size))
+                    return false;
+                sprite.pos *= float(map->cell_size);
+                sprite.size *= map->cell_size;
+                map->sprites.sprites.push_back(sprite);
+                if (!map->textures.count(sprite.texture))
+                    map->textures[sprite.texture] = placeholder_texture();
+            }
+            else if (section == "cells")
+            {
+                int id;
+                std::string kind;
+                float height;
+                if (!(map_file >> id >> kind >> height) || id < 0 || id >= CELL_BORDER)
+                    return false;
+                const char *kinds[] = { "solid", "door_x", "door_y", "diagonal", "antidiagonal" };
+                auto it = std::find(std::begin(kinds), std::end(kinds), kind);
+                if (it == std::end(kinds))
+                    return false;
+                set_cell_type(map, id, cell_kind_t(it - std::begin(kinds)), height);
+            }
+            else
+            {
+                return false;
+            }
+        }
+    }
+    index_sprites(&map->sprites, rows, cols, map->cell_size);
+    load_floor_ceiling(map);
+    return true;
+}
+
+void
+init_binary_map(const std::string &filename, const map_view_t &view,
+                map_t *map)
+{
+    const map_header_t &header = *view.header;
+    init_map(filename, header.width, header.height, map);
+    for (uint32_t i = 0; i < header.texture_count; ++i)
+    {
+        const map_texture_t &texture = view.textures[i];
+        std::string path(texture.path, strnlen(texture.path, sizeof(texture.path)));
+        add_texture(texture.id, path, map);
+    }
+    // Entries a text map couldn't hold either are skipped
+    for (uint32_t i = 0; i < header.cell_type_count; ++i)
+    {
+        const map_cell_type_t &type = view.cell_types[i];
+        if (type.id < CELL_BORDER && type.kind <= CELL_ANTIDIAGONAL)
+            set_cell_type(map, type.id, cell_kind_t(type.kind), type.height);
+    }
+    for (uint32_t i = 0; i < header.sprite_count; ++i)
+    {
+        const map_sprite_t &entry = view.sprites[i];
+        sprite_t sprite;
+        sprite.pos = { entry.x * map->cell_size, entry.y * map->cell_size };
+        sprite.texture = int(entry.texture);
+        sprite.size = entry.size * map->cell_size;
+        map->sprites.sprites.push_back(sprite);
+        if (!map->textures.count(sprite.texture))
+            map->textures[sprite.texture] = placeholder_texture();
+    }
+    index_sprites(&map->sprites, map->width, map->height, map->cell_size);
+    load_floor_ceiling(map);
+}
+
+bool
+load_binary_map(const std::string &filename, map_t *map)
+{
+    map_view_t view;
+    if (!open_map_view(filename, &view))
+        return false;
+
+    const map_header_t &header = *view.header;
+    init_binary_map(filename, view, map);
+
+    // The file's rows are the grid's rows without the border
+    init_grid(map, header.width, header.height, GRID_ROWS);
+    for (int y = 0; y < map->height; ++y)
+        std::copy_n(&view.cells[size_t(y) * map->width], map->width,
+                    &map->grid[map->index(0, y)]);
+    close_map_view(&view);
+
+    // Ids in use, looked up once each rather than once per cell
+    std::vector<uint8_t> used(CELL_EMPTY + 1, 0);
+    for (uint16_t cell : map->grid)
+        used[cell] = 1;
+    for (int id = 0; id < CELL_BORDER; ++id)
+        if (used[id] && !map->textures.count(id))
+            map->textures[id] = placeholder_texture();
+    return true;
+}
+
+bool
+load_map(const std::string &filename, map_t *map)
+{
+    if (is_binary_map(filename))
+        return load_binary_map(filename, map);
+    return parse_map(filename, map);
+}
+
+bool
+save_binary_map(const std::string &filename, const map_t &map)
+{
+    std::vector<std::pair<int, std::string>> textures(map.texture_paths.begin(),
+                                                      map.texture_paths.end());
+    // Only the cell ids that aren't plain walls
+    std::vector<map_cell_type_t> cell_types;
+    for (int id = 0; id < CELL_BORDER; ++id)
+    {
+        const cell_type_t &type = map.cell_types[id];
+        if (type.kind != CELL_SOLID || type.height != 1)
+            cell_types.push_back({ uint32_t(id), uint32_t(type.kind), type.height });
+    }
+    std::vector<map_sprite_t> sprites;
+    for (const sprite_t &sprite : map.sprites.sprites)
+        sprites.push_back({ sprite.pos.x / map.cell_size, sprite.pos.y / map.cell_size,
+                            uint32_t(sprite.texture), sprite.size / map.cell_size });
+    std::vector<uint16_t> cells(size_t(map.width) * map.height);
+    for (int y = 0; y < map.height; ++y)
+        for (int x = 0; x < map.width; ++x)
+            cells[size_t(y) * map.width + x] = map.at(x, y);
+    return write_binary_map(filename, map.width, map.height, textures,
+                            cell_types, sprites, cells);
+}
+
+void
+unload_map(map_t *map)
+{
+    map->textures.clear();
+    UnloadImage(map->floor_texture);
+    UnloadImage(map->ceiling_texture);
+}
+
+void
+load_textures(map_t *map)
+{
+    for (auto &[id, path] : map->texture_paths)
+        map->textures[id] = load_texture_file(map->directory + "/" + path);
+}
+
+void
+request_textures(const map_t &map, texture_loader_t *loader)
+{
+    for (auto &[id, path] : map.texture_paths)
+        loader->request(id, map.directory + "/" + path);
+}
+
+int
+install_textures(map_t *map, texture_loader_t *loader)
+{
+    std::vector<std::pair<int, texture_t>> finished = loader->take_finished();
+    for (auto &[id, texture] : finished)
+        map->textures[id] = std::move(texture);
+    return int(finished.size());
+}
+
+void
+init_grid(map_t *map, int width, int height, grid_layout_t layout)
+{
+    map->layout = layout;
+    size_t size;
+    if (layout == GRID_ROWS)
+    {
+        map->stride = width + 2;
+        size = size_t(map->stride) * (height + 2);
+    }
+    else
+    {
+        int tiles_h = (height + 2 + GRID_TILE_SIZE - 1) / GRID_TILE_SIZE;
+        map->stride = (width + 2 + GRID_TILE_SIZE - 1) / GRID_TILE_SIZE;
+        size = size_t(map->stride) * tiles_h * GRID_TILE_SIZE * GRID_TILE_SIZE;
+    }
+    // Tiles past the border are never read
+    map->grid.assign(size, CELL_EMPTY);
+    for (int x = -1; x <= width; ++x)
+    {
+        map->set(x, -1, CELL_BORDER);
+        map->set(x, height, CELL_BORDER);
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        map->set(-1, y, CELL_BORDER);
+        map->set(width, y, CELL_BORDER);
+    }
+}
+
+void
+set_grid_layout(map_t *map, grid_layout_t layout)
+{
+    if (map->layout == GRID_CHUNKS || layout == GRID_CHUNKS)
+        return;
+    map_t old;
+    old.layout = map->layout;
+    old.stride = map->stride;
+    old.grid = std::move(map->grid);
+    init_grid(map, map->width, map->height, layout);
+    for (int y = 0; y < map->height; ++y)
+        for (int x = 0; x < map->width; ++x)
+            map->set(x, y, old.at(x, y));
+}
+
+void
+set_cell_type(map_t *map, uint16_t id, cell_kind_t kind, float height)
+{
+    cell_type_t &type = map->cell_types[id];
+    type.kind = kind;
+    type.height = std::clamp(height, MIN_WALL_HEIGHT, 1.0f);
+    type.full = kind == CELL_SOLID && type.height >= 1;
+}
+
+bool
+correct_cell(const map_t &map, int x, int y)
+{
+    return (x >= 0 && x < map.width) && (y >= 0 && y < map.height);
+}
@@ -0,0 +1,174 @@
+#ifndef MAP_HPP
+#define MAP_HPP
+
+#include <raylib-ext.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "map_format.hpp"
+#include "sprite.hpp"
+#include "texture.hpp"
+
+// Cell values besides texture ids
+const uint16_t CELL_EMPTY = MAP_EMPTY;
+// Solid, untextured cells around the map
+const uint16_t CELL_BORDER = 0xfffe;
+// Side of a cell in world units
+const int CELL_SIZE = 72;
+
+// What a cell with a given id is, see cell_type_t
+enum cell_kind_t {
+    // Fills the cell
+    CELL_SOLID,
+    // A panel across the middle of the cell, facing along x or y, which
+    // slides open along itself
+    CELL_DOOR_X,
+    CELL_DOOR_Y,
+    // A thin wall from corner 0, 0 of the cell to 1, 1, or from 0, 1 to
+    // 1, 0
+    CELL_DIAGONAL,
+    CELL_ANTIDIAGONAL,
+};
+
+// Walls are between half a cell high, the eye, and a full cell, the
+// ceiling. Every wall then covers the horizon, so the walls a column
+// sees make up one run of rows, floor below and ceiling above.
+const float MIN_WALL_HEIGHT = 0.5f;
+
+struct cell_type_t {
+    cell_kind_t kind;
+    // Height in cells
+    float height;
+    // Solid and a full cell high, so nothing behind it can be seen and
+    // rays stop at its face without a closer look
+    bool full;
+};
+
+enum grid_layout_t {
+    // Row by row
+    GRID_ROWS,
+    // GRID_TILE_SIZE square tiles row by row, cells of a tile in Morton
+    // (Z) order, so cells close in any direction are close in memory
+    GRID_TILES,
+    // CHUNK_SIZE square chunks, each row by row, found through a table so
+    // that only some of them need to be in memory, see stream.hpp
+    GRID_CHUNKS,
+};
+
+const int GRID_TILE_SIZE = 8;
+const int CHUNK_SIZE = 64;
+
+// A grid of cells, each either empty or a wall with a texture id. In a
+// text map file every line is one x.
+struct map_t {
+    int width, height;
+    // Side of a cell in world units
+    int cell_size;
+    // Cells in one array, surrounded by a one cell wide border of
+    // CELL_BORDER, so rays stop at the edge of the map without checking
+    // for it. stride is the width of the bordered grid for GRID_ROWS and
+    // its width in tiles or chunks for the others.
+    grid_layout_t layout;
+    int stride;
+    std::vector<uint16_t> grid;
+    // GRID_CHUNKS only: every chunk of the bordered grid, row by row.
+    // Chunks that aren't loaded point to one filled with CELL_BORDER.
+    std::vector<const uint16_t *> chunk_table;
+    // Wall textures by id, placeholders until load_textures() or a
+    // texture_loader_t replace them
+    std::map<int, texture_t> textures;
+    // Texture paths by id as given in the map file, relative to directory
+    std::map<int, std::string> texture_paths;
+    std::string directory;
+    // RGBA8 so they can be sampled directly
+    Image floor_texture;
+    Image ceiling_texture;
+    // Indexed with index_sprites() whenever they change
+    sprite_set_t sprites;
+    // Type of every cell id, solid and full height unless the map says
+    // otherwise
+    std::vector<cell_type_t> cell_types;
+    // How far open doors are, from 0 to 1, by y * width + x. Doors not in
+    // here are shut.
+    std::unordered_map<size_t, float> doors;
+
+    // Index in grid of cell x, y, which may be one cell outside the map.
+    // Chunked grids have no single array and no index.
+    size_t index(int x, int y) const
+    {
+        x++, y++;
+        if (layout == GRID_ROWS)
+            return size_t(y) * stride + x;
+        size_t tile = size_t(y / GRID_TILE_SIZE) * stride + x / GRID_TILE_SIZE;
+        return tile * GRID_TILE_SIZE * GRID_TILE_SIZE +
+            (spread_bits(x % GRID_TILE_SIZE) | spread_bits(y % GRID_TILE_SIZE) << 1);
+    }
+
+    uint16_t at(int x, int y) const
+    {
+        if (layout == GRID_CHUNKS)
+        {
+            unsigned bx = x + 1, by = y + 1;
+            const uint16_t *chunk = chunk_table[(by / CHUNK_SIZE) * stride + bx / CHUNK_SIZE];
+            return chunk[(by % CHUNK_SIZE) * CHUNK_SIZE + bx % CHUNK_SIZE];
+        }
+        return grid[index(x, y)];
+    }
+
+    void set(int x, int y, uint16_t cell)
+    {
+        grid[index(x, y)] = cell;
+    }
+
+    float door_open(int x, int y) const
+    {
+        auto it = doors.find(size_t(y) * width + x);
+        return it == doors.end() ? 0 : it->second;
+    }
+
+private:
+    // abc -> a0b0c, interleaving the three bits of a coordinate within a
+    // tile with zeros
+    static int spread_bits(int v)
+    {
+        return (v & 1) | (v & 2) << 1 | (v & 4) << 2;
+    }
+};
+
+// Allocate an empty grid with its border, GRID_ROWS or GRID_TILES
+void init_grid(map_t *map, int width, int height, grid_layout_t layout);
+// Lay the cells of a fully loaded map out again
+void set_grid_layout(map_t *map, grid_layout_t layout);
+
+// Text map: "width height texture_count", then texture_count lines of
+// "id path" and the cells. Texture paths are relative to the map file.
+// Optionally followed by sections, each a name and a count:
+//   sprites N, then N lines of "x y texture size", in cells
+//   cells N, then N lines of "id kind height", kind being solid, door_x,
+//   door_y, diagonal or antidiagonal and height in cells
+bool parse_map(const std::string &filename, map_t *map);
+// Binary map, see map_format.hpp
+bool load_binary_map(const std::string &filename, map_t *map);
+// Either kind of map, told apart by the binary map's magic
+bool load_map(const std::string &filename, map_t *map);
+// Everything but the cells of a mapped binary map: its size, textures,
+// cell types and sprites
+void init_binary_map(const std::string &filename, const map_view_t &view,
+                     map_t *map);
+bool save_binary_map(const std::string &filename, const map_t &map);
+void unload_map(map_t *map);
+// Decode every wall texture now
+void load_textures(map_t *map);
+// Decode them in the background instead, installing the ones that are
+// ready with install_textures() between frames
+void request_textures(const map_t &map, texture_loader_t *loader);
+int install_textures(map_t *map, texture_loader_t *loader);
+
+// Give cell id a type, height clamped to what walls can be
+void set_cell_type(map_t *map, uint16_t id, cell_kind_t kind, float height);
+
+bool correct_cell(const map_t &map, int x, int y);
+
+#endif // MAP_HPP
@@ -0,0 +1,171 @@
+#include "map_format.hpp"
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool
+is_binary_map(const std::string &filename)
+{
+    char magic[sizeof(MAP_MAGIC)];
+    std::ifstream file(filename, std::ios::binary);
+    return file.read(magic, sizeof(magic)) &&
+        !memcmp(magic, MAP_MAGIC, sizeof(magic));
+}
+
+// Maps the whole file, sets data and size
+static bool
+map_file(const std::string &filename, map_view_t *view)
+{
+#ifdef _WIN32
+    view->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (view->file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    view->mapping = NULL;
+    if (GetFileSizeEx(view->file, &size) && size.QuadPart > 0)
+        view->mapping = CreateFileMappingA(view->file, NULL, PAGE_READONLY,
+                                           0, 0, NULL);
+    if (!view->mapping) {
+        CloseHandle(view->file);
+        return false;
+    }
+    view->data = MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+    view->size = size_t(size.QuadPart);
+    if (!view->data) {
+        CloseHandle(view->mapping);
+        CloseHandle(view->file);
+        return false;
+    }
+    return true;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    view->data = data;
+    view->size = size_t(st.st_size);
+    return true;
+#endif
+}
+
+bool
+open_map_view(const std::string &filename, map_view_t *view)
+{
+    if (!map_file(filename, view))
+        return false;
+
+    const char *bytes = (const char *)view->data;
+    view->header = (const map_header_t *)bytes;
+    view->cells = nullptr;
+    if (view->size < sizeof(map_header_t)) {
+        close_map_view(view);
+        return false;
+    }
+
+    // The tables follow the header one after the other
+    const map_header_t &header = *view->header;
+    size_t textures_offset = sizeof(map_header_t);
+    size_t cell_types_offset = textures_offset +
+        size_t(header.texture_count) * sizeof(map_texture_t);
+    size_t sprites_offset = cell_types_offset +
+        size_t(header.cell_type_count) * sizeof(map_cell_type_t);
+    size_t tables_end = sprites_offset +
+        size_t(header.sprite_count) * sizeof(map_sprite_t);
+    view->textures = (const map_texture_t *)(bytes + textures_offset);
+    view->cell_types = (const map_cell_type_t *)(bytes + cell_types_offset);
+    view->sprites = (const map_sprite_t *)(bytes + sprites_offset);
+
+    bool sized = header.width > 0 && header.width <= MAX_MAP_SIZE &&
+        header.height > 0 && header.height <= MAX_MAP_SIZE;
+    size_t cells_size = sized
+        ? size_t(header.width) * header.height * sizeof(uint16_t) : 0;
+    bool valid = sized &&
+        !memcmp(header.magic, MAP_MAGIC, sizeof(MAP_MAGIC)) &&
+        header.version == MAP_VERSION &&
+        header.cells_offset % alignof(uint16_t) == 0 &&
+        header.cells_offset >= tables_end &&
+        header.cells_offset <= view->size &&
+        cells_size <= view->size - header.cells_offset;
+    if (!valid) {
+        close_map_view(view);
+        return false;
+    }
+    view->cells = (const uint16_t *)(bytes + header.cells_offset);
+    return true;
+}
+
+void
+close_map_view(map_view_t *view)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(view->data);
+    CloseHandle(view->mapping);
+    CloseHandle(view->file);
+#else
+    munmap((void *)view->data, view->size);
+#endif
+    view->data = nullptr;
+    view->size = 0;
+}
+
+bool
+write_binary_map(const std::string &filename, int width, int height,
+                 const std::vector<std::pair<int, std::string>> &textures,
+                 const std::vector<map_cell_type_t> &cell_types,
+                 const std::vector<map_sprite_t> &sprites,
+                 const std::vector<uint16_t> &cells)
+{
+    if (width <= 0 || height <= 0 || uint32_t(width) > MAX_MAP_SIZE ||
+        uint32_t(height) > MAX_MAP_SIZE ||
+        cells.size() != size_t(width) * height)
+        return false;
+    // Checked before the file is opened so a bad path leaves nothing behind
+    for (auto &texture : textures)
+        if (texture.second.size() >= sizeof(map_texture_t::path))
+            return false;
+
+    map_header_t header = {};
+    memcpy(header.magic, MAP_MAGIC, sizeof(MAP_MAGIC));
+    header.version = MAP_VERSION;
+    header.width = width;
+    header.height = height;
+    header.texture_count = textures.size();
+    header.cell_type_count = cell_types.size();
+    header.sprite_count = sprites.size();
+    header.cells_offset = sizeof(map_header_t) +
+        textures.size() * sizeof(map_texture_t) +
+        cell_types.size() * sizeof(map_cell_type_t) +
+        sprites.size() * sizeof(map_sprite_t);
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write((const char *)&header, sizeof(header));
+    for (auto &[id, path] : textures) {
+        map_texture_t texture = {};
+        texture.id = id;
+        memcpy(texture.path, path.c_str(), path.size());
+        file.write((const char *)&texture, sizeof(texture));
+    }
+    file.write((const char *)cell_types.data(),
+               cell_types.size() * sizeof(map_cell_type_t));
+    file.write((const char *)sprites.data(),
+               sprites.size() * sizeof(map_sprite_t));
+    file.write((const char *)cells.data(), cells.size() * sizeof(uint16_t));
+    return bool(file);
+}
@@ -0,0 +1,84 @@
+#ifndef MAP_FORMAT_HPP
+#define MAP_FORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary map file: a map_header_t, texture_count map_texture_t entries,
+// cell_type_count map_cell_type_t entries, sprite_count map_sprite_t
+// entries and width * height uint16 cells, row by row (cell x, y at
+// y * width + x).
+// Fields are little endian, like every machine the projects build for, so
+// a mapped file is used as it is, without parsing.
+const char MAP_MAGIC[4] = { 'R', 'M', 'A', 'P' };
+const uint32_t MAP_VERSION = 2;
+// Cell value of an empty cell
+const uint16_t MAP_EMPTY = 0xffff;
+// Widest and tallest map in cells, so sizes fit an int and the cell count
+// can't overflow
+const uint32_t MAX_MAP_SIZE = 1 << 16;
+
+struct map_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t texture_count;
+    // Offset of the cells from the start of the file
+    uint32_t cells_offset;
+    uint32_t cell_type_count;
+    uint32_t sprite_count;
+};
+
+struct map_texture_t {
+    uint32_t id;
+    // Relative to the map file, NUL terminated
+    char path[252];
+};
+
+// Type of a cell id that isn't a solid, full height wall, see cell_type_t
+struct map_cell_type_t {
+    uint32_t id;
+    // A cell_kind_t
+    uint32_t kind;
+    // In cells
+    float height;
+};
+
+// Position and size in cells, see sprite_t
+struct map_sprite_t {
+    float x, y;
+    uint32_t texture;
+    float size;
+};
+
+// A binary map file mapped read-only into memory
+struct map_view_t {
+    const map_header_t *header;
+    const map_texture_t *textures;
+    const map_cell_type_t *cell_types;
+    const map_sprite_t *sprites;
+    const uint16_t *cells;
+
+    const void *data;
+    size_t size;
+#ifdef _WIN32
+    void *file, *mapping;
+#endif
+};
+
+// Whether a file starts with MAP_MAGIC
+bool is_binary_map(const std::string &filename);
+// Maps a binary map file and checks that its header fits its size
+bool open_map_view(const std::string &filename, map_view_t *view);
+void close_map_view(map_view_t *view);
+// Writes a binary map, cells laid out as in the file
+bool write_binary_map(const std::string &filename, int width, int height,
+                      const std::vector<std::pair<int, std::string>> &textures,
+                      const std::vector<map_cell_type_t> &cell_types,
+                      const std::vector<map_sprite_t> &sprites,
+                      const std::vector<uint16_t> &cells);
+
+#endif // MAP_FORMAT_HPP
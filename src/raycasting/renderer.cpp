@@ -0,0 +1,473 @@
+#include "renderer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+framebuffer_t::framebuffer_t(int width, int height)
+    : width(width), height(height), pixels(width * height, BLACK),
+      wall_top(width, 0), wall_bottom(width, 0), depth(width, 0),
+      plane_fov(0)
+{
+}
+
+// The camera basis for this frame: rays go through a plane one unit in
+// front of the player, spanning [-half_plane, half_plane] along right
+struct view_t {
+    Vector2 forward, right;
+    float half_plane;
+};
+
+// Distance shading darkens every channel by the same amount, clamped to
+// zero. A row per amount, indexed by channel value, turns that into one
+// lookup per channel.
+struct shade_table_t {
+    uint8_t rows[256][256];
+
+    shade_table_t()
+    {
+        for (int shading = 0; shading < 256; ++shading)
+            for (int value = 0; value < 256; ++value)
+                rows[shading][value] = uint8_t(std::max(value - shading, 0));
+    }
+};
+
+static const shade_table_t SHADE_TABLE;
+
+// Row of SHADE_TABLE for a shading amount, anything from 255 up is black
+static const uint8_t *
+shade_row(int shading)
+{
+    return SHADE_TABLE.rows[std::clamp(shading, 0, 255)];
+}
+
+static Color
+shade(Color pixel, const uint8_t *row)
+{
+    return { row[pixel.r], row[pixel.g], row[pixel.b], pixel.a };
+}
+
+// The smallest mip level with at least as many rows as the texture
+// covers pixels, so that a texel covers about a pixel
+static const mip_level_t &
+mip_level(const texture_t &texture, float rows)
+{
+    int level = 0;
+    while (level + 1 < int(texture.levels.size()) &&
+           texture.levels[level + 1].height >= rows)
+        level++;
+    return texture.levels[level];
+}
+
+// Rows a wall covers on screen, unclipped: from its top down to the floor
+// under it, the eye being half a cell above the floor. cell_rows is the
+// height of a full wall, and textures are anchored to the floor, so a
+// short wall shows the bottom of its texture.
+struct wall_rows_t {
+    float top, bottom, cell_rows;
+};
+
+static wall_rows_t
+wall_rows(const map_t &map, const hit_t &hit, int height)
+{
+    float cell_rows = (map.cell_size * height) / hit.dist;
+    float wall_height = hit.cell == -1 ? 1 : map.cell_types[hit.cell].height;
+    float bottom = (height + cell_rows) / 2;
+    return { bottom - wall_height * cell_rows, bottom, cell_rows };
+}
+
+// The walls a column's ray hit, near to far. Walls reach from the floor
+// past the horizon, so one further away only shows above the nearer ones.
+static void
+draw_column(const map_t &map, const ray_hits_t &hits,
+            int x, framebuffer_t *framebuffer)
+{
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+    Color *pixels = framebuffer->pixels.data();
+
+    // Rows from clip down are taken by nearer walls
+    int clip = height;
+    for (int h = 0; h < hits.count; ++h)
+    {
+        const hit_t &hit = hits.hits[h];
+        const uint8_t *shading = shade_row(int(128.0 * hit.dist / 900));
+        wall_rows_t rows = wall_rows(map, hit, height);
+        int wall_top = std::clamp(int(rows.top), 0, height);
+        int wall_bottom = std::min(std::clamp(int(rows.bottom), 0, height), clip);
+        if (h == 0)
+            framebuffer->wall_bottom[x] = wall_bottom;
+
+        // Rays that hit nothing leave a gap between floor and ceiling
+        if (hit.cell == -1)
+        {
+            for (int row = wall_top; row < wall_bottom; ++row)
+                pixels[row * width + x] = BLACK;
+        }
+        else
+        {
+            const mip_level_t &image = mip_level(map.textures.at(hit.cell), rows.cell_rows);
+            const Color *color_data = image.pixels.data();
+            int col = std::clamp(int(hit.u * image.width), 0, image.width - 1);
+            float cell_top = rows.bottom - rows.cell_rows;
+            for (int row = wall_top; row < wall_bottom; ++row)
+            {
+                // The first row can start up to a pixel above the wall,
+                // where it rounded down
+                int i = std::clamp(int((row - cell_top) / rows.cell_rows * image.height),
+                                   0, image.height - 1);
+                pixels[row * width + x] = shade(color_data[i * image.width + col], shading);
+            }
+        }
+        clip = std::min(clip, wall_top);
+    }
+
+    framebuffer->wall_top[x] = clip;
+    framebuffer->depth[x] = hits.last().dist;
+}
+
+// One row of floor below the horizon and its mirror image on the ceiling,
+// skipping the pixels covered by walls. Every pixel of the row lies at
+// the same distance from the camera plane, so the floor positions under
+// it are evenly spaced along a line and found by stepping, not per pixel.
+static void
+draw_floor_row(const map_t &map, const player_t &player, const view_t &view,
+               int row, framebuffer_t *framebuffer)
+{
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+    Color *pixels = framebuffer->pixels.data();
+
+    // The eye is half a cell above the floor, which projects to the same
+    // wall heights as draw_column()
+    float dy = row + 0.5f - height / 2.0f;
+    float dist = map.cell_size * height / (2 * dy);
+
+    // Floor under the left and right edges of the screen, in cells
+    // from the corner of the player's cell. Textures repeat every cell, and
+    // small coordinates keep the rounding of each step from adding up far
+    // from the origin of big maps.
+    Vector2 eye = player.pos / map.cell_size;
+    eye = { eye.x - floorf(eye.x), eye.y - floorf(eye.y) };
+    Vector2 left_edge = eye + (view.forward - view.right * view.half_plane) * (dist / map.cell_size);
+    Vector2 right_edge = eye + (view.forward + view.right * view.half_plane) * (dist / map.cell_size);
+    // Stepped in 16.16 fixed point: no rounding builds up along the row,
+    // and shifting rounds negative coordinates down like positive ones
+    const float ONE = 1 << 16;
+    Vector2 step = (right_edge - left_edge) / width;
+    int64_t fx = llroundf((left_edge.x + step.x / 2) * ONE);
+    int64_t fy = llroundf((left_edge.y + step.y / 2) * ONE);
+    int64_t step_x = llroundf(step.x * ONE);
+    int64_t step_y = llroundf(step.y * ONE);
+
+    const Image &floor_texture = map.floor_texture;
+    const Image &ceiling_texture = map.ceiling_texture;
+    const Color *floor_data = (const Color *)floor_texture.data;
+    const Color *ceiling_data = (const Color *)ceiling_texture.data;
+    int fw = floor_texture.width, fh = floor_texture.height;
+    int cw = ceiling_texture.width, ch = ceiling_texture.height;
+
+    const uint8_t *shading = shade_row(int(1.0 / float(row) * height * 28));
+    int ceiling_row = height - 1 - row;
+    Color *floor_pixels = &pixels[row * width];
+    Color *ceiling_pixels = &pixels[ceiling_row * width];
+    const int *wall_top = framebuffer->wall_top.data();
+    const int *wall_bottom = framebuffer->wall_bottom.data();
+    for (int x = 0; x < width; ++x, fx += step_x, fy += step_y)
+    {
+        // Textures are tiled once per cell, their sizes are powers of two
+        if (row >= wall_bottom[x])
+        {
+            int tx = int((fx * fw) >> 16) & (fw - 1);
+            int ty = int((fy * fh) >> 16) & (fh - 1);
+            floor_pixels[x] = shade(floor_data[ty * fw + tx], shading);
+        }
+        if (ceiling_row < wall_top[x])
+        {
+            int tx = int((fx * cw) >> 16) & (cw - 1);
+            int ty = int((fy * ch) >> 16) & (ch - 1);
+            ceiling_pixels[x] = shade(ceiling_data[ty * cw + tx], shading);
+        }
+    }
+}
+
+// Sprites closer to the camera plane than this, in world units, aren't
+// drawn, so that their size on screen stays finite
+const float SPRITE_NEAR = 1;
+
+// Project the sprites that can be seen into framebuffer->sprites, near to
+// far. Nothing is seen past the farthest wall, so only the blocks of
+// sprites within that distance and inside the view are looked at, which
+// keeps a crowded map as cheap as the part of it in view.
+static void
+find_sprites(const map_t &map, const player_t &player, const view_t &view,
+             framebuffer_t *framebuffer)
+{
+    const sprite_set_t &set = map.sprites;
+    std::vector<visible_sprite_t> &visible = framebuffer->sprites;
+    visible.clear();
+    if (set.block_sprites.empty())
+        return;
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+    float far = *std::max_element(framebuffer->depth.begin(), framebuffer->depth.end());
+
+    // Bounding box of the view triangle, in blocks
+    float block_size = float(SPRITE_BLOCK * map.cell_size);
+    Vector2 left_far = {
+        player.pos.x + (view.forward.x - view.right.x * view.half_plane) * far,
+        player.pos.y + (view.forward.y - view.right.y * view.half_plane) * far,
+    };
+    Vector2 right_far = {
+        player.pos.x + (view.forward.x + view.right.x * view.half_plane) * far,
+        player.pos.y + (view.forward.y + view.right.y * view.half_plane) * far,
+    };
+    float min_x = std::min({ player.pos.x, left_far.x, right_far.x }) - set.max_size;
+    float max_x = std::max({ player.pos.x, left_far.x, right_far.x }) + set.max_size;
+    float min_y = std::min({ player.pos.y, left_far.y, right_far.y }) - set.max_size;
+    float max_y = std::max({ player.pos.y, left_far.y, right_far.y }) + set.max_size;
+    int min_bx = std::max(int(std::floor(min_x / block_size)), 0);
+    int max_bx = std::min(int(std::floor(max_x / block_size)), set.width - 1);
+    int min_by = std::max(int(std::floor(min_y / block_size)), 0);
+    int max_by = std::min(int(std::floor(max_y / block_size)), set.height - 1);
+
+    // A block is skipped when it lies, with everything standing in it,
+    // behind the camera, past the farthest wall or outside an edge of the
+    // view. reach is the radius of a block plus how far a sprite can
+    // stick out of it.
+    float reach = block_size * 0.7072f + set.max_size;
+    float edge_reach = reach * sqrtf(1 + view.half_plane * view.half_plane);
+    for (int by = min_by; by <= max_by; ++by)
+    {
+        for (int bx = min_bx; bx <= max_bx; ++bx)
+        {
+            float cx = (bx + 0.5f) * block_size - player.pos.x;
+            float cy = (by + 0.5f) * block_size - player.pos.y;
+            float block_depth = cx * view.forward.x + cy * view.forward.y;
+            float block_side = cx * view.right.x + cy * view.right.y;
+            if (block_depth + reach < SPRITE_NEAR || block_depth - reach > far ||
+                std::abs(block_side) - block_depth * view.half_plane > edge_reach)
+                continue;
+
+            int block = by * set.width + bx;
+            for (int i = set.block_start[block]; i < set.block_start[block + 1]; ++i)
+            {
+                int index = set.block_sprites[i];
+                const sprite_t &sprite = set.sprites[index];
+                float x = sprite.pos.x - player.pos.x;
+                float y = sprite.pos.y - player.pos.y;
+                float depth = x * view.forward.x + y * view.forward.y;
+                if (depth < SPRITE_NEAR || depth >= far)
+                    continue;
+                float side = x * view.right.x + y * view.right.y;
+
+                // Same scale as walls: standing on the floor, half a cell
+                // below the eye
+                const mip_level_t &image = map.textures.at(sprite.texture).levels[0];
+                float scale = height / depth;
+                visible_sprite_t projected;
+                projected.sprite = index;
+                projected.depth = depth;
+                projected.height = sprite.size * scale;
+                projected.width = projected.height * image.width / image.height;
+                projected.left = (1 + side / (depth * view.half_plane)) * width / 2 -
+                    projected.width / 2;
+                projected.top = height / 2.0f + map.cell_size / 2 * scale - projected.height;
+                if (projected.left + projected.width <= 0 || projected.left >= width)
+                    continue;
+                visible.push_back(projected);
+            }
+        }
+    }
+
+    std::sort(visible.begin(), visible.end(),
+              [](const visible_sprite_t &a, const visible_sprite_t &b) {
+                  return a.depth < b.depth;
+              });
+}
+
+// The columns [begin, end) of every visible sprite, each column only
+// above the walls in front of the sprite. Sprites go near to far and
+// never draw over a pixel a nearer one has drawn, so crowds cost about
+// what the pixels they cover do rather than every sprite behind them.
+static void
+draw_sprites(const map_t &map, const std::vector<ray_hits_t> &hits,
+             int begin, int end, framebuffer_t *framebuffer)
+{
+    int width = framebuffer->width;
+    int height = framebuffer->height;
+    Color *pixels = framebuffer->pixels.data();
+    uint8_t *drawn = framebuffer->sprite_drawn.data();
+    const float *wall_depth = framebuffer->depth.data();
+    // Rows of every column already covered by sprites, all opaque, where
+    // the column is skipped without looking at its pixels
+    int cover_top[SLICE_COLUMNS], cover_bottom[SLICE_COLUMNS];
+    std::fill_n(cover_top, SLICE_COLUMNS, 0);
+    std::fill_n(cover_bottom, SLICE_COLUMNS, 0);
+
+    for (const visible_sprite_t &projected : framebuffer->sprites)
+    {
+        // Pixels whose centres are inside the sprite's rectangle
+        int first_x = std::max(int(std::ceil(projected.left - 0.5f)), begin);
+        int last_x = std::min(int(std::ceil(projected.left + projected.width - 0.5f)), end);
+        if (first_x >= last_x)
+            continue;
+        int first_y = std::max(int(std::ceil(projected.top - 0.5f)), 0);
+        int last_y = std::min(int(std::ceil(projected.top + projected.height - 0.5f)), height);
+
+        const sprite_t &sprite = map.sprites.sprites[projected.sprite];
+        const mip_level_t &image = mip_level(map.textures.at(sprite.texture), projected.height);
+        const Color *color_data = image.pixels.data();
+        const uint8_t *shading = shade_row(int(128.0 * projected.depth / 900));
+        float texel_step = image.height / projected.height;
+        float first_texel = (first_y + 0.5f - projected.top) * texel_step;
+
+        for (int x = first_x; x < last_x; ++x)
+        {
+            // Walls in front of the sprite hide it from their tops down
+            if (wall_depth[x] <= projected.depth)
+                continue;
+            int column_last_y = last_y;
+            for (int h = 0; h < hits[x].count && hits[x].hits[h].dist < projected.depth; ++h)
+            {
+                int wall_top = int(wall_rows(map, hits[x].hits[h], height).top);
+                column_last_y = std::min(column_last_y, std::max(wall_top, 0));
+            }
+            int &top = cover_top[x - begin], &bottom = cover_bottom[x - begin];
+            if (first_y >= column_last_y || (first_y >= top && column_last_y <= bottom))
+                continue;
+            int col = int((x + 0.5f - projected.left) / projected.width * image.width);
+            col = std::clamp(col, 0, image.width - 1);
+            float texel = first_texel;
+            bool opaque = true;
+            for (int row = first_y; row < column_last_y; ++row, texel += texel_step)
+            {
+                int i = row * width + x;
+                if (drawn[i])
+                    continue;
+                Color color = color_data[std::min(int(texel), image.height - 1) * image.width + col];
+                if (color.a < 128)
+                {
+                    opaque = false;
+                    continue;
+                }
+                pixels[i] = shade(color, shading);
+                drawn[i] = 1;
+            }
+
+            // Grow the covered rows when this column joins up with them
+            if (!opaque)
+                continue;
+            if (top >= bottom || (first_y <= bottom && column_last_y >= top))
+            {
+                top = top >= bottom ? first_y : std::min(top, first_y);
+                bottom = std::max(bottom, column_last_y);
+            }
+        }
+    }
+}
+
+void
+render_view(const map_t &map, const player_t &player, cast_mode_t mode,
+            thread_pool_t *pool, framebuffer_t *framebuffer,
+            std::vector<ray_hits_t> *hits)
+{
+    // One ray through the middle of every column
+    int width = framebuffer->width;
+    hits->resize(width);
+    framebuffer->wall_top.resize(width);
+    framebuffer->wall_bottom.resize(width);
+    framebuffer->depth.resize(width);
+    // Columns are evenly spaced on the camera plane, so floor rows map
+    // linearly to screen rows. Their offsets only change with the fov,
+    // each frame just turns the basis they are measured in.
+    view_t view;
+    view.forward = { cosf(player.rotation), sinf(player.rotation) };
+    view.right = { -view.forward.y, view.forward.x };
+    view.half_plane = tanf(player.fov / 2 * DEG2RAD);
+    if (framebuffer->plane_fov != player.fov)
+    {
+        framebuffer->plane_x.resize(width);
+        for (int x = 0; x < width; ++x)
+            framebuffer->plane_x[x] = (2 * (x + 0.5f) / width - 1) * view.half_plane;
+        framebuffer->plane_fov = player.fov;
+    }
+    const float *plane_x = framebuffer->plane_x.data();
+    auto column_ray = [&](int x) {
+        return Vector2{ view.forward.x + view.right.x * plane_x[x],
+                        view.forward.y + view.right.y * plane_x[x] };
+    };
+
+    // Walls first. Columns are independent, so each slice is cast and
+    // drawn by whichever thread picks it up.
+    auto render_slice = [&](int slice) {
+        int begin = slice * SLICE_COLUMNS;
+        int end = std::min(begin + SLICE_COLUMNS, width);
+        if (mode == CAST_PACKET)
+        {
+            // The last packet repeats its last column to fill the lanes
+            for (int x = begin; x < end; x += PACKET_SIZE)
+            {
+                Vector2 rays[PACKET_SIZE];
+                ray_hits_t packet[PACKET_SIZE];
+                for (int l = 0; l < PACKET_SIZE; ++l)
+                    rays[l] = column_ray(std::min(x + l, end - 1));
+                cast_packet(map, player.pos, rays, packet);
+                std::copy_n(packet, std::min(PACKET_SIZE, end - x), &(*hits)[x]);
+            }
+        }
+        else
+        {
+            for (int x = begin; x < end; ++x)
+                (*hits)[x] = cast_ray(map, player.pos, column_ray(x));
+        }
+
+        for (int x = begin; x < end; ++x)
+            draw_column(map, (*hits)[x], x, framebuffer);
+    };
+
+    // Then rows of floor and ceiling around the walls, from the horizon
+    // down
+    int first_row = framebuffer->height / 2;
+    auto render_rows = [&](int band) {
+        int begin = first_row + band * BAND_ROWS;
+        int end = std::min(begin + BAND_ROWS, framebuffer->height);
+        for (int row = begin; row < end; ++row)
+            draw_floor_row(map, player, view, row, framebuffer);
+    };
+
+    // Sprites last, over everything else. Finding and sorting them takes
+    // the whole depth buffer, so it happens once between the passes.
+    auto render_sprites = [&](int slice) {
+        int begin = slice * SLICE_COLUMNS;
+        draw_sprites(map, *hits, begin, std::min(begin + SLICE_COLUMNS, width), framebuffer);
+    };
+
+    int slices = (width + SLICE_COLUMNS - 1) / SLICE_COLUMNS;
+    int bands = (framebuffer->height - first_row + BAND_ROWS - 1) / BAND_ROWS;
+    if (pool)
+    {
+        pool->run(slices, render_slice);
+        pool->run(bands, render_rows);
+    }
+    else
+    {
+        for (int slice = 0; slice < slices; ++slice)
+            render_slice(slice);
+        for (int band = 0; band < bands; ++band)
+            render_rows(band);
+    }
+
+    find_sprites(map, player, view, framebuffer);
+    if (framebuffer->sprites.empty())
+        return;
+    framebuffer->sprite_drawn.assign(framebuffer->pixels.size(), 0);
+    if (pool)
+    {
+        pool->run(slices, render_sprites);
+    }
+    else
+    {
+        for (int slice = 0; slice < slices; ++slice)
+            render_sprites(slice);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include "caster.hpp"
+#include "thread_pool.hpp"
+
+// Columns rendered as one task. A whole number of packets, and wide
+// enough that threads rarely write to the same cache line.
+const int SLICE_COLUMNS = 2 * PACKET_SIZE;
+// Floor rows rendered as one task
+const int BAND_ROWS = 8;
+
+struct player_t {
+    Vector2 pos;
+    float rotation;
+    float speed;
+    // Horizontal field of view in degrees
+    float fov;
+};
+
+// A sprite in view, where it lands on the screen
+struct visible_sprite_t {
+    int sprite;
+    // Distance from the camera plane
+    float depth;
+    // Screen rectangle of the whole sprite, which can reach off screen
+    float left, top, width, height;
+};
+
+// RGBA pixels of the 3D view, row by row, uploaded to the GPU in one go
+struct framebuffer_t {
+    int width, height;
+    std::vector<Color> pixels;
+    // Rows [wall_top, wall_bottom) of every column are covered by its wall,
+    // floor and ceiling fill the rest
+    std::vector<int> wall_top, wall_bottom;
+    // Distance from the camera plane where every column's ray stopped.
+    // Sprites are only drawn in columns where they are closer, above the
+    // walls in front of them.
+    std::vector<float> depth;
+    // Offset of every column's ray along the camera plane, rebuilt by
+    // render_view() when the fov differs from plane_fov
+    float plane_fov;
+    std::vector<float> plane_x;
+    // Sprites of the current frame that can be seen, near to far, and
+    // the pixels they have drawn
+    std::vector<visible_sprite_t> sprites;
+    std::vector<uint8_t> sprite_drawn;
+
+    framebuffer_t(int width, int height);
+};
+
+// Casts one ray per framebuffer column and draws walls, floor, ceiling
+// and the map's sprites on the CPU. Needs no window, so it can be benchmarked headless.
+// Slices of columns are spread over the pool, or rendered on the calling
+// thread when pool is null.
+void render_view(const map_t &map, const player_t &player, cast_mode_t mode,
+                 thread_pool_t *pool, framebuffer_t *framebuffer,
+                 std::vector<ray_hits_t> *hits);
+
+#endif // RENDERER_HPP
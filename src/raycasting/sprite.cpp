@@ -0,0 +1,34 @@
+#include "sprite.hpp"
+#include <algorithm>
+#include <cmath>
+
+void
+index_sprites(sprite_set_t *set, int width, int height, int cell_size)
+{
+    set->width = (width + SPRITE_BLOCK - 1) / SPRITE_BLOCK;
+    set->height = (height + SPRITE_BLOCK - 1) / SPRITE_BLOCK;
+    set->max_size = 0;
+
+    // Counting sort by block: count, turn counts into starts, then place
+    std::vector<int> blocks(set->sprites.size(), -1);
+    set->block_start.assign(size_t(set->width) * set->height + 1, 0);
+    for (size_t i = 0; i < set->sprites.size(); ++i)
+    {
+        const sprite_t &sprite = set->sprites[i];
+        int x = int(std::floor(sprite.pos.x / cell_size));
+        int y = int(std::floor(sprite.pos.y / cell_size));
+        if (x < 0 || x >= width || y < 0 || y >= height)
+            continue;
+        blocks[i] = (y / SPRITE_BLOCK) * set->width + x / SPRITE_BLOCK;
+        set->block_start[blocks[i] + 1]++;
+        set->max_size = std::max(set->max_size, sprite.size);
+    }
+    for (size_t block = 0; block + 1 < set->block_start.size(); ++block)
+        set->block_start[block + 1] += set->block_start[block];
+
+    set->block_sprites.resize(set->block_start.back());
+    std::vector<int> next(set->block_start.begin(), set->block_start.end() - 1);
+    for (size_t i = 0; i < blocks.size(); ++i)
+        if (blocks[i] >= 0)
+            set->block_sprites[next[blocks[i]]++] = int(i);
+}
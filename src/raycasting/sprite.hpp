@@ -0,0 +1,41 @@
+#ifndef SPRITE_HPP
+#define SPRITE_HPP
+
+#include <raylib-ext.hpp>
+#include <vector>
+
+// An object drawn as a picture that always faces the camera, standing on
+// the floor
+struct sprite_t {
+    // Where it stands, in world units
+    Vector2 pos;
+    // Texture id in map_t::textures. Texels with alpha under 128 are
+    // see-through.
+    int texture;
+    // Height in world units, the width follows the texture
+    float size;
+};
+
+// Side of the square blocks of cells sprites are bucketed by
+const int SPRITE_BLOCK = 4;
+
+// The sprites of a map, bucketed by the block of cells they stand in, so
+// that the renderer only looks at the blocks in view instead of every
+// sprite
+struct sprite_set_t {
+    std::vector<sprite_t> sprites;
+    // Size of the map in blocks. Sprites in block x, y are
+    // block_sprites[block_start[i]] up to block_sprites[block_start[i + 1]],
+    // with i = y * width + x. Sprites outside the map are left out.
+    int width, height;
+    std::vector<int> block_start;
+    std::vector<int> block_sprites;
+    // Largest size of any sprite, how far one can reach out of its block
+    float max_size;
+};
+
+// Bucket the sprites of a map width by height cells, again after adding,
+// removing or moving some
+void index_sprites(sprite_set_t *set, int width, int height, int cell_size);
+
+#endif // SPRITE_HPP
@@ -0,0 +1,122 @@
+#include "stream.hpp"
+#include <algorithm>
+#include <cmath>
+
+const size_t CHUNK_BYTES = CHUNK_SIZE * CHUNK_SIZE * sizeof(uint16_t);
+
+bool
+open_map_stream(const std::string &filename, size_t max_bytes,
+                map_stream_t *stream, map_t *map)
+{
+    if (!open_map_view(filename, &stream->view))
+        return false;
+    init_binary_map(filename, stream->view, map);
+
+    stream->max_bytes = max_bytes;
+    stream->bytes = 0;
+    stream->tick = 0;
+    stream->chunks.clear();
+    stream->solid.assign(CHUNK_SIZE * CHUNK_SIZE, CELL_BORDER);
+    stream->known.assign(CELL_EMPTY + 1, 0);
+    stream->known[CELL_EMPTY] = stream->known[CELL_BORDER] = 1;
+
+    // Chunks cover the map and its border
+    map->layout = GRID_CHUNKS;
+    map->stride = (map->width + 2 + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    int chunks_h = (map->height + 2 + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    map->grid.clear();
+    map->chunk_table.assign(size_t(map->stride) * chunks_h, stream->solid.data());
+    return true;
+}
+
+// Copy a chunk out of the file, adding the border where it reaches the
+// edge of the map
+static void
+load_chunk(map_stream_t *stream, map_t *map, int cx, int cy, chunk_t *chunk)
+{
+    chunk->cells.assign(CHUNK_SIZE * CHUNK_SIZE, CELL_BORDER);
+    // Bordered coordinates of the chunk's corner, and the part of the
+    // map inside it
+    int x0 = cx * CHUNK_SIZE - 1, y0 = cy * CHUNK_SIZE - 1;
+    int begin_x = std::max(x0, 0), end_x = std::min(x0 + CHUNK_SIZE, map->width);
+    int begin_y = std::max(y0, 0), end_y = std::min(y0 + CHUNK_SIZE, map->height);
+    for (int y = begin_y; y < end_y; ++y)
+    {
+        const uint16_t *row = &stream->view.cells[size_t(y) * map->width];
+        uint16_t *out = &chunk->cells[(y - y0) * CHUNK_SIZE + begin_x - x0];
+        std::copy(row + begin_x, row + end_x, out);
+    }
+
+    // Textures the map's table doesn't have get placeholders like in
+    // fully loaded maps
+    for (uint16_t cell : chunk->cells)
+    {
+        if (stream->known[cell])
+            continue;
+        stream->known[cell] = 1;
+        if (!map->textures.count(cell))
+            map->textures[cell] = placeholder_texture();
+    }
+}
+
+int
+stream_chunks(map_stream_t *stream, map_t *map, Vector2 pos, int radius)
+{
+    stream->tick++;
+    int chunks_w = map->stride;
+    int chunks_h = int(map->chunk_table.size()) / chunks_w;
+    // Chunk range in bordered cells
+    auto chunk_of = [&](float world) {
+        return int(std::floor(world / map->cell_size + 1)) / CHUNK_SIZE;
+    };
+    int min_cx = std::max(chunk_of(pos.x - radius * map->cell_size), 0);
+    int max_cx = std::min(chunk_of(pos.x + radius * map->cell_size), chunks_w - 1);
+    int min_cy = std::max(chunk_of(pos.y - radius * map->cell_size), 0);
+    int max_cy = std::min(chunk_of(pos.y + radius * map->cell_size), chunks_h - 1);
+
+    int loaded = 0;
+    for (int cy = min_cy; cy <= max_cy; ++cy)
+    {
+        for (int cx = min_cx; cx <= max_cx; ++cx)
+        {
+            int index = cy * chunks_w + cx;
+            auto [it, inserted] = stream->chunks.try_emplace(index);
+            chunk_t &chunk = it->second;
+            chunk.last_used = stream->tick;
+            if (!inserted)
+                continue;
+            load_chunk(stream, map, cx, cy, &chunk);
+            map->chunk_table[index] = chunk.cells.data();
+            stream->bytes += CHUNK_BYTES;
+            loaded++;
+        }
+    }
+
+    if (stream->bytes > stream->max_bytes)
+    {
+        // Oldest first, sparing the chunks needed now
+        std::vector<std::pair<long long, int>> candidates;
+        for (auto &[index, chunk] : stream->chunks)
+            if (chunk.last_used != stream->tick)
+                candidates.push_back({ chunk.last_used, index });
+        std::sort(candidates.begin(), candidates.end());
+        for (auto [last_used, index] : candidates)
+        {
+            if (stream->bytes <= stream->max_bytes)
+                break;
+            map->chunk_table[index] = stream->solid.data();
+            stream->chunks.erase(index);
+            stream->bytes -= CHUNK_BYTES;
+        }
+    }
+    return loaded;
+}
+
+void
+close_map_stream(map_stream_t *stream, map_t *map)
+{
+    close_map_view(&stream->view);
+    stream->chunks.clear();
+    stream->bytes = 0;
+    map->chunk_table.assign(map->chunk_table.size(), stream->solid.data());
+}
@@ -0,0 +1,45 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "map.hpp"
+
+// Memory the chunks of a streamed map may use by default
+const size_t DEFAULT_STREAM_BYTES = 16 << 20;
+
+struct chunk_t {
+    std::vector<uint16_t> cells;
+    // Value of map_stream_t::tick when the chunk was last needed
+    long long last_used;
+};
+
+// Keeps the chunks of a binary map around a point in memory, reading them
+// from the mapped file as they come into range and dropping the least
+// recently used ones once over max_bytes. The map it streams into has a
+// GRID_CHUNKS grid.
+struct map_stream_t {
+    map_view_t view;
+    size_t max_bytes;
+    size_t bytes;
+    long long tick;
+    // Loaded chunks by index in map_t::chunk_table
+    std::unordered_map<int, chunk_t> chunks;
+    // Stands in for chunks that aren't loaded
+    std::vector<uint16_t> solid;
+    // Cell ids already checked for a texture
+    std::vector<uint8_t> known;
+};
+
+bool open_map_stream(const std::string &filename, size_t max_bytes,
+                     map_stream_t *stream, map_t *map);
+// Load the chunks within radius cells of pos (in world units), then evict
+// until under the memory cap. Chunks in range are never evicted, so a
+// small cap and a large radius can go over it. Returns the number of
+// chunks loaded.
+int stream_chunks(map_stream_t *stream, map_t *map, Vector2 pos, int radius);
+void close_map_stream(map_stream_t *stream, map_t *map);
+
+#endif // STREAM_HPP
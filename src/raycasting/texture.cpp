@@ -0,0 +1,139 @@
+#include "texture.hpp"
+#include <algorithm>
+
+// Average of the up to 2x2 texels of the previous level under each texel
+static mip_level_t
+downsample(const mip_level_t &level)
+{
+    mip_level_t half;
+    half.width = std::max(level.width / 2, 1);
+    half.height = std::max(level.height / 2, 1);
+    half.pixels.resize(half.width * half.height);
+    for (int y = 0; y < half.height; ++y)
+    {
+        int y0 = std::min(2 * y, level.height - 1);
+        int y1 = std::min(2 * y + 1, level.height - 1);
+        for (int x = 0; x < half.width; ++x)
+        {
+            int x0 = std::min(2 * x, level.width - 1);
+            int x1 = std::min(2 * x + 1, level.width - 1);
+            const Color texels[4] = {
+                level.pixels[y0 * level.width + x0],
+                level.pixels[y0 * level.width + x1],
+                level.pixels[y1 * level.width + x0],
+                level.pixels[y1 * level.width + x1],
+            };
+            int r = 0, g = 0, b = 0, a = 0;
+            for (const Color &texel : texels)
+            {
+                r += texel.r;
+                g += texel.g;
+                b += texel.b;
+                a += texel.a;
+            }
+            half.pixels[y * half.width + x] = {
+                uint8_t((r + 2) / 4), uint8_t((g + 2) / 4),
+                uint8_t((b + 2) / 4), uint8_t((a + 2) / 4),
+            };
+        }
+    }
+    return half;
+}
+
+texture_t
+make_texture(Image image)
+{
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    const Color *pixels = (const Color *)image.data;
+
+    texture_t texture;
+    texture.levels.push_back({
+        image.width, image.height,
+        std::vector<Color>(pixels, pixels + image.width * image.height),
+    });
+    UnloadImage(image);
+    while (texture.levels.back().width > 1 || texture.levels.back().height > 1)
+        texture.levels.push_back(downsample(texture.levels.back()));
+    return texture;
+}
+
+texture_t
+placeholder_texture()
+{
+    return make_texture(GenImageChecked(64, 64, 8, 8, MAGENTA, BLACK));
+}
+
+texture_t
+load_texture_file(const std::string &path)
+{
+    Image image = LoadImage(path.c_str());
+    if (!image.data)
+        return placeholder_texture();
+    return make_texture(image);
+}
+
+texture_loader_t::texture_loader_t()
+    : decoding(0), quit(false)
+{
+    thread = std::thread(&texture_loader_t::work, this);
+}
+
+texture_loader_t::~texture_loader_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void
+texture_loader_t::request(int id, const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back({ id, path });
+    }
+    wake.notify_one();
+}
+
+int
+texture_loader_t::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return int(queue.size()) + decoding;
+}
+
+std::vector<std::pair<int, texture_t>>
+texture_loader_t::take_finished()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<int, texture_t>> out;
+    out.swap(finished);
+    return out;
+}
+
+void
+texture_loader_t::work()
+{
+    while (true)
+    {
+        std::pair<int, std::string> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return quit || !queue.empty(); });
+            if (quit)
+                return;
+            job = std::move(queue.front());
+            queue.pop_front();
+            decoding++;
+        }
+        texture_t texture = load_texture_file(job.second);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back({ job.first, std::move(texture) });
+            decoding--;
+        }
+    }
+}
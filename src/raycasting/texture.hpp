@@ -0,0 +1,57 @@
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <raylib-ext.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct mip_level_t {
+    int width, height;
+    std::vector<Color> pixels;
+};
+
+// A wall texture and its mip levels, each a 2x2 box filtered half of the
+// one before, down to 1x1. Distant walls sample a small level, which
+// reads less memory and doesn't shimmer.
+struct texture_t {
+    std::vector<mip_level_t> levels;
+};
+
+// Takes ownership of the image, whatever its format
+texture_t make_texture(Image image);
+// Missing textures show up as a checkerboard instead of crashing the
+// renderer
+texture_t placeholder_texture();
+texture_t load_texture_file(const std::string &path);
+
+// Decodes textures on a thread of its own. Whoever owns the textures
+// installs the finished ones between frames, so the renderer never sees
+// one change under it.
+struct texture_loader_t {
+    texture_loader_t();
+    ~texture_loader_t();
+
+    void request(int id, const std::string &path);
+    // Textures queued or being decoded
+    int pending();
+    // Decoded textures by id, handed over once
+    std::vector<std::pair<int, texture_t>> take_finished();
+
+private:
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<int, std::string>> queue;
+    std::vector<std::pair<int, texture_t>> finished;
+    int decoding;
+    bool quit;
+
+    void work();
+};
+
+#endif // TEXTURE_HPP
@@ -0,0 +1,74 @@
+#include "thread_pool.hpp"
+
+thread_pool_t::thread_pool_t(int threads)
+    : task(nullptr), count(0), next(0), busy(0), batch(0), quit(false)
+{
+    for (int i = 1; i < threads; ++i)
+        workers.emplace_back(&thread_pool_t::work, this);
+}
+
+thread_pool_t::~thread_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+int
+thread_pool_t::size() const
+{
+    return int(workers.size()) + 1;
+}
+
+void
+thread_pool_t::run(int count, const std::function<void(int)> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        this->count = count;
+        next = 0;
+        busy = int(workers.size());
+        batch++;
+    }
+    wake.notify_all();
+    drain();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    this->task = nullptr;
+}
+
+void
+thread_pool_t::drain()
+{
+    // Tasks are handed out one at a time, so threads that get cheap ones
+    // simply take more
+    for (int i = next++; i < count; i = next++)
+        (*task)(i);
+}
+
+void
+thread_pool_t::work()
+{
+    long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || batch != seen; });
+            if (quit)
+                return;
+            seen = batch;
+        }
+        drain();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        done.notify_one();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads started once and reused every frame. The calling thread works
+// too, so a pool of one thread runs everything serially.
+struct thread_pool_t {
+    thread_pool_t(int threads);
+    ~thread_pool_t();
+
+    int size() const;
+    // Calls task(i) for every i in [0, count), spread over all threads,
+    // and returns once every call has finished
+    void run(int count, const std::function<void(int)> &task);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int)> *task;
+    int count;
+    std::atomic<int> next;
+    // Workers still busy with the current batch
+    int busy;
+    long long batch;
+    bool quit;
+
+    void work();
+    void drain();
+};
+
+#endif // THREAD_POOL_HPP